@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// the little of libgpiod that libmqttgpio uses: chips, one request for a
+// set of output lines written in one call, and single input lines with
+// edge events; ./configure builds gpio-v1.c or gpio-v2.c against it, the
+// bench links mock-gpiod.c instead
+
+#ifndef GPIO_BACKEND_H
+#define GPIO_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// the most lines one output request holds (the uAPI limit, both versions)
+#define GPIO_OUT_MAX 64
+
+typedef struct GPIOchip GPIOchip_t;
+typedef struct GPIOout GPIOout_t;
+typedef struct GPIOin GPIOin_t;
+
+typedef struct {
+	bool rising;
+	uint64_t tsNs;	// CLOCK_MONOTONIC
+} GPIOedge_t;
+
+// which libgpiod the backend was built for, for the logs
+extern const char *gpioBackend_G;
+
+// anything gpiod_chip_open_lookup() took: name, /dev path, number or label
+GPIOchip_t *gpio_chip_open (const char *descr_p);
+const char *gpio_chip_name (GPIOchip_t *chip_p);
+unsigned gpio_chip_lines (GPIOchip_t *chip_p);
+void gpio_chip_close (GPIOchip_t *chip_p);
+
+// values are 0/1, in the order of offsets_p; 0 on success
+GPIOout_t *gpio_out_request (GPIOchip_t *chip_p, const unsigned *offsets_p, unsigned cnt, const int *vals_p,
+		const char *consumer_p);
+int gpio_out_set (GPIOout_t *out_p, const int *vals_p);
+void gpio_out_release (GPIOout_t *out_p);
+
+// both edges; if the backend can have the kernel debounce the line,
+// *debounced_p is set and every edge read is already a settled level
+GPIOin_t *gpio_in_request (GPIOchip_t *chip_p, unsigned offset, int debounceMs, bool *debounced_p,
+		const char *consumer_p);
+int gpio_in_fd (GPIOin_t *in_p);
+int gpio_in_read (GPIOin_t *in_p, GPIOedge_t *edges_p, unsigned max);
+int gpio_in_value (GPIOin_t *in_p);
+void gpio_in_release (GPIOin_t *in_p);
+
+#endif
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// gpio-backend.h on libgpiod v1: an output request is a line bulk, an
+// input is a line with its own event fd; there's no kernel debounce in
+// the v1 uAPI, libmqttgpio times it itself
+
+#include <stdlib.h>
+#include <string.h>
+#include <gpiod.h>
+
+#include "gpio-backend.h"
+
+#define EVENT_BATCH 16
+
+_Static_assert(GPIOD_LINE_BULK_MAX_LINES >= GPIO_OUT_MAX, "a bulk holds a whole output request");
+
+struct GPIOchip {
+	struct gpiod_chip *chip;
+};
+
+struct GPIOout {
+	struct gpiod_line_bulk bulk;
+};
+
+struct GPIOin {
+	struct gpiod_line *line;
+};
+
+const char *gpioBackend_G = "libgpiod v1";
+
+GPIOchip_t *
+gpio_chip_open (const char *descr_p)
+{
+	GPIOchip_t *chip_p;
+
+	chip_p = (GPIOchip_t*)malloc(sizeof(GPIOchip_t));
+	if (chip_p == NULL)
+		return NULL;
+	chip_p->chip = gpiod_chip_open_lookup(descr_p);
+	if (chip_p->chip == NULL) {
+		free(chip_p);
+		return NULL;
+	}
+	return chip_p;
+}
+
+const char *
+gpio_chip_name (GPIOchip_t *chip_p)
+{
+	return gpiod_chip_name(chip_p->chip);
+}
+
+unsigned
+gpio_chip_lines (GPIOchip_t *chip_p)
+{
+	return gpiod_chip_num_lines(chip_p->chip);
+}
+
+void
+gpio_chip_close (GPIOchip_t *chip_p)
+{
+	gpiod_chip_close(chip_p->chip);
+	free(chip_p);
+}
+
+GPIOout_t *
+gpio_out_request (GPIOchip_t *chip_p, const unsigned *offsets_p, unsigned cnt, const int *vals_p, const char *consumer_p)
+{
+	unsigned i;
+	GPIOout_t *out_p;
+	struct gpiod_line *line_p;
+	struct gpiod_line_request_config config;
+
+	if (cnt > GPIO_OUT_MAX)
+		return NULL;
+	out_p = (GPIOout_t*)malloc(sizeof(GPIOout_t));
+	if (out_p == NULL)
+		return NULL;
+	gpiod_line_bulk_init(&out_p->bulk);
+	for (i=0; i<cnt; ++i) {
+		line_p = gpiod_chip_get_line(chip_p->chip, offsets_p[i]);
+		if (line_p == NULL) {
+			free(out_p);
+			return NULL;
+		}
+		gpiod_line_bulk_add(&out_p->bulk, line_p);
+	}
+
+	memset(&config, 0, sizeof(config));
+	config.consumer = consumer_p;
+	config.request_type = GPIOD_LINE_REQUEST_DIRECTION_OUTPUT;
+	if (gpiod_line_request_bulk(&out_p->bulk, &config, vals_p) != 0) {
+		free(out_p);
+		return NULL;
+	}
+	return out_p;
+}
+
+int
+gpio_out_set (GPIOout_t *out_p, const int *vals_p)
+{
+	return gpiod_line_set_value_bulk(&out_p->bulk, vals_p);
+}
+
+void
+gpio_out_release (GPIOout_t *out_p)
+{
+	gpiod_line_release_bulk(&out_p->bulk);
+	free(out_p);
+}
+
+GPIOin_t *
+gpio_in_request (GPIOchip_t *chip_p, unsigned offset, __attribute__((unused)) int debounceMs, bool *debounced_p,
+		const char *consumer_p)
+{
+	GPIOin_t *in_p;
+
+	*debounced_p = false;
+	in_p = (GPIOin_t*)malloc(sizeof(GPIOin_t));
+	if (in_p == NULL)
+		return NULL;
+	in_p->line = gpiod_chip_get_line(chip_p->chip, offset);
+	if ((in_p->line == NULL) || (gpiod_line_request_both_edges_events(in_p->line, consumer_p) != 0)) {
+		free(in_p);
+		return NULL;
+	}
+	return in_p;
+}
+
+int
+gpio_in_fd (GPIOin_t *in_p)
+{
+	return gpiod_line_event_get_fd(in_p->line);
+}
+
+// the v1 uAPI stamps events with CLOCK_MONOTONIC since Linux 5.7
+int
+gpio_in_read (GPIOin_t *in_p, GPIOedge_t *edges_p, unsigned max)
+{
+	int i, cnt;
+	struct gpiod_line_event eventBuf[EVENT_BATCH];
+
+	if (max > EVENT_BATCH)
+		max = EVENT_BATCH;
+	cnt = gpiod_line_event_read_multiple(in_p->line, eventBuf, max);
+	for (i=0; i<cnt; ++i) {
+		edges_p[i].rising = (eventBuf[i].event_type == GPIOD_LINE_EVENT_RISING_EDGE);
+		edges_p[i].tsNs = (uint64_t)eventBuf[i].ts.tv_sec * 1000000000 + (uint64_t)eventBuf[i].ts.tv_nsec;
+	}
+	return cnt;
+}
+
+int
+gpio_in_value (GPIOin_t *in_p)
+{
+	return gpiod_line_get_value(in_p->line);
+}
+
+void
+gpio_in_release (GPIOin_t *in_p)
+{
+	gpiod_line_release(in_p->line);
+	free(in_p);
+}
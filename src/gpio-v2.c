@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// gpio-backend.h on libgpiod v2: an output request is one
+// gpiod_line_request over all its offsets, set with one call; an input is
+// a request for one line with an edge event buffer, and a debounce period
+// the kernel applies (since Linux 5.10)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <gpiod.h>
+
+#include "gpio-backend.h"
+
+#define EVENT_BATCH 16
+
+struct GPIOchip {
+	struct gpiod_chip *chip;
+	char *name;
+	unsigned lines;
+};
+
+struct GPIOout {
+	struct gpiod_line_request *req;
+	unsigned cnt;
+	unsigned offsets[GPIO_OUT_MAX];
+	enum gpiod_line_value vals[GPIO_OUT_MAX];
+};
+
+struct GPIOin {
+	struct gpiod_line_request *req;
+	unsigned offset;
+	struct gpiod_edge_event_buffer *buf;
+};
+
+const char *gpioBackend_G = "libgpiod v2";
+
+static struct gpiod_chip *
+open_path (const char *path_p)
+{
+	if (!gpiod_is_gpiochip_device(path_p))
+		return NULL;
+	return gpiod_chip_open(path_p);
+}
+
+// v2 only opens paths, the rest of what v1's lookup took is done here
+static struct gpiod_chip *
+open_by_label (const char *label_p)
+{
+	DIR *dir_p;
+	struct dirent *ent_p;
+	struct gpiod_chip *chip_p = NULL;
+	struct gpiod_chip_info *info_p;
+	char path[PATH_MAX];
+	bool found;
+
+	dir_p = opendir("/dev");
+	if (dir_p == NULL)
+		return NULL;
+	while ((chip_p == NULL) && ((ent_p = readdir(dir_p)) != NULL)) {
+		if (strncmp(ent_p->d_name, "gpiochip", 8) != 0)
+			continue;
+		snprintf(path, sizeof(path), "/dev/%s", ent_p->d_name);
+		chip_p = open_path(path);
+		if (chip_p == NULL)
+			continue;
+		info_p = gpiod_chip_get_info(chip_p);
+		found = (info_p != NULL) && (strcmp(gpiod_chip_info_get_label(info_p), label_p) == 0);
+		gpiod_chip_info_free(info_p);
+		if (!found) {
+			gpiod_chip_close(chip_p);
+			chip_p = NULL;
+		}
+	}
+	closedir(dir_p);
+	return chip_p;
+}
+
+GPIOchip_t *
+gpio_chip_open (const char *descr_p)
+{
+	char path[PATH_MAX];
+	struct gpiod_chip *chip_p;
+	struct gpiod_chip_info *info_p;
+	GPIOchip_t *gpioChip_p;
+
+	if (descr_p[0] == '/')
+		chip_p = open_path(descr_p);
+	else {
+		if (strspn(descr_p, "0123456789") == strlen(descr_p))
+			snprintf(path, sizeof(path), "/dev/gpiochip%s", descr_p);
+		else
+			snprintf(path, sizeof(path), "/dev/%s", descr_p);
+		chip_p = open_path(path);
+		if (chip_p == NULL)
+			chip_p = open_by_label(descr_p);
+	}
+	if (chip_p == NULL)
+		return NULL;
+
+	info_p = gpiod_chip_get_info(chip_p);
+	gpioChip_p = (GPIOchip_t*)calloc(1, sizeof(GPIOchip_t));
+	if ((info_p == NULL) || (gpioChip_p == NULL)) {
+		gpiod_chip_info_free(info_p);
+		free(gpioChip_p);
+		gpiod_chip_close(chip_p);
+		return NULL;
+	}
+	gpioChip_p->chip = chip_p;
+	gpioChip_p->name = strdup(gpiod_chip_info_get_name(info_p));
+	gpioChip_p->lines = gpiod_chip_info_get_num_lines(info_p);
+	gpiod_chip_info_free(info_p);
+	if (gpioChip_p->name == NULL) {
+		gpio_chip_close(gpioChip_p);
+		return NULL;
+	}
+	return gpioChip_p;
+}
+
+const char *
+gpio_chip_name (GPIOchip_t *chip_p)
+{
+	return chip_p->name;
+}
+
+unsigned
+gpio_chip_lines (GPIOchip_t *chip_p)
+{
+	return chip_p->lines;
+}
+
+void
+gpio_chip_close (GPIOchip_t *chip_p)
+{
+	gpiod_chip_close(chip_p->chip);
+	free(chip_p->name);
+	free(chip_p);
+}
+
+// each line gets its own initial value, the settings are copied into the
+// line config as they're added
+GPIOout_t *
+gpio_out_request (GPIOchip_t *chip_p, const unsigned *offsets_p, unsigned cnt, const int *vals_p, const char *consumer_p)
+{
+	unsigned i;
+	bool ok;
+	GPIOout_t *out_p;
+	struct gpiod_line_settings *settings_p;
+	struct gpiod_line_config *lineCfg_p;
+	struct gpiod_request_config *reqCfg_p;
+
+	if (cnt > GPIO_OUT_MAX)
+		return NULL;
+	out_p = (GPIOout_t*)calloc(1, sizeof(GPIOout_t));
+	settings_p = gpiod_line_settings_new();
+	lineCfg_p = gpiod_line_config_new();
+	reqCfg_p = gpiod_request_config_new();
+	ok = (out_p != NULL) && (settings_p != NULL) && (lineCfg_p != NULL) && (reqCfg_p != NULL)
+		&& (gpiod_line_settings_set_direction(settings_p, GPIOD_LINE_DIRECTION_OUTPUT) == 0);
+	for (i=0; ok && (i<cnt); ++i) {
+		out_p->offsets[i] = offsets_p[i];
+		out_p->vals[i] = ((vals_p != NULL) && vals_p[i])? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+		ok = (gpiod_line_settings_set_output_value(settings_p, out_p->vals[i]) == 0)
+			&& (gpiod_line_config_add_line_settings(lineCfg_p, &offsets_p[i], 1, settings_p) == 0);
+	}
+	if (ok) {
+		out_p->cnt = cnt;
+		gpiod_request_config_set_consumer(reqCfg_p, consumer_p);
+		out_p->req = gpiod_chip_request_lines(chip_p->chip, reqCfg_p, lineCfg_p);
+		ok = (out_p->req != NULL);
+	}
+
+	gpiod_request_config_free(reqCfg_p);
+	gpiod_line_config_free(lineCfg_p);
+	gpiod_line_settings_free(settings_p);
+	if (!ok) {
+		free(out_p);
+		return NULL;
+	}
+	return out_p;
+}
+
+int
+gpio_out_set (GPIOout_t *out_p, const int *vals_p)
+{
+	unsigned i;
+
+	for (i=0; i<out_p->cnt; ++i)
+		out_p->vals[i] = vals_p[i]? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+	return gpiod_line_request_set_values_subset(out_p->req, out_p->cnt, out_p->offsets, out_p->vals);
+}
+
+void
+gpio_out_release (GPIOout_t *out_p)
+{
+	gpiod_line_request_release(out_p->req);
+	free(out_p);
+}
+
+GPIOin_t *
+gpio_in_request (GPIOchip_t *chip_p, unsigned offset, int debounceMs, bool *debounced_p, const char *consumer_p)
+{
+	bool ok;
+	GPIOin_t *in_p;
+	struct gpiod_line_settings *settings_p;
+	struct gpiod_line_config *lineCfg_p;
+	struct gpiod_request_config *reqCfg_p;
+
+	*debounced_p = false;
+	in_p = (GPIOin_t*)calloc(1, sizeof(GPIOin_t));
+	settings_p = gpiod_line_settings_new();
+	lineCfg_p = gpiod_line_config_new();
+	reqCfg_p = gpiod_request_config_new();
+	ok = (in_p != NULL) && (settings_p != NULL) && (lineCfg_p != NULL) && (reqCfg_p != NULL)
+		&& (gpiod_line_settings_set_direction(settings_p, GPIOD_LINE_DIRECTION_INPUT) == 0)
+		&& (gpiod_line_settings_set_edge_detection(settings_p, GPIOD_LINE_EDGE_BOTH) == 0)
+		&& (gpiod_line_settings_set_event_clock(settings_p, GPIOD_LINE_CLOCK_MONOTONIC) == 0);
+	if (ok) {
+		if (debounceMs > 0)
+			gpiod_line_settings_set_debounce_period_us(settings_p, (unsigned long)debounceMs * 1000);
+		ok = (gpiod_line_config_add_line_settings(lineCfg_p, &offset, 1, settings_p) == 0);
+	}
+	if (ok) {
+		gpiod_request_config_set_consumer(reqCfg_p, consumer_p);
+		gpiod_request_config_set_event_buffer_size(reqCfg_p, EVENT_BATCH);
+		in_p->offset = offset;
+		in_p->buf = gpiod_edge_event_buffer_new(EVENT_BATCH);
+		in_p->req = gpiod_chip_request_lines(chip_p->chip, reqCfg_p, lineCfg_p);
+		ok = (in_p->buf != NULL) && (in_p->req != NULL);
+	}
+
+	gpiod_request_config_free(reqCfg_p);
+	gpiod_line_config_free(lineCfg_p);
+	gpiod_line_settings_free(settings_p);
+	if (!ok) {
+		if (in_p != NULL) {
+			if (in_p->req != NULL)
+				gpiod_line_request_release(in_p->req);
+			gpiod_edge_event_buffer_free(in_p->buf);
+		}
+		free(in_p);
+		return NULL;
+	}
+	*debounced_p = (debounceMs > 0);
+	return in_p;
+}
+
+int
+gpio_in_fd (GPIOin_t *in_p)
+{
+	return gpiod_line_request_get_fd(in_p->req);
+}
+
+int
+gpio_in_read (GPIOin_t *in_p, GPIOedge_t *edges_p, unsigned max)
+{
+	int i, cnt;
+	struct gpiod_edge_event *event_p;
+
+	if (max > EVENT_BATCH)
+		max = EVENT_BATCH;
+	cnt = gpiod_line_request_read_edge_events(in_p->req, in_p->buf, max);
+	for (i=0; i<cnt; ++i) {
+		event_p = gpiod_edge_event_buffer_get_event(in_p->buf, i);
+		edges_p[i].rising = (gpiod_edge_event_get_event_type(event_p) == GPIOD_EDGE_EVENT_RISING_EDGE);
+		edges_p[i].tsNs = gpiod_edge_event_get_timestamp_ns(event_p);
+	}
+	return cnt;
+}
+
+int
+gpio_in_value (GPIOin_t *in_p)
+{
+	return (int)gpiod_line_request_get_value(in_p->req, in_p->offset);
+}
+
+void
+gpio_in_release (GPIOin_t *in_p)
+{
+	gpiod_line_request_release(in_p->req);
+	gpiod_edge_event_buffer_free(in_p->buf);
+	free(in_p);
+}
@@ -0,0 +1,851 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// the text config: one line at a time into a CONFIG_t, then the checks
+// --compile-config adds on top of what startup needs
+
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "libmqttgpio-int.h"
+
+#define DEFAULT_CMD_GRACE_MS 5000
+#define DEFAULT_CMD_MAX 16
+#define SCENE_PAYLOAD_MAX 32
+
+static void pack_tables (CONFIG_t *cfg_p);
+static bool parse_int (const char *str_p, int min, int max, int *val_p);
+
+bool
+process_config_file (const char *fileName_p, CONFIG_t *cfg_p)
+{
+	FILE *stream;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t nread;
+	const char *delim = " \t\n";
+	char *token;
+	const char *name_p;
+	unsigned lineCnt;
+	int i;
+	BROKERinfo_t *broker_p;
+	GPIOinfo_t *gpio_p;
+	CMDinfo_t *cmd_p;
+	SUBinfo_t *sub_p;
+	SCENEinfo_t *scene_p;
+	SCENEset_t *set_p;
+	char *val_p;
+	INPUTinfo_t *input_p;
+	PUBinfo_t *pub_p;
+
+	if (fileName_p == NULL) {
+		log_err("no config file specified\n");
+		return false;
+	}
+
+	stream = fopen(fileName_p, "r");
+	if (stream == NULL) {
+		perror("fopen()");
+		log_err("%s\n", fileName_p);
+		return false;
+	}
+
+	memset(cfg_p, 0, sizeof(CONFIG_t));
+	cfg_p->cmdGraceMs = DEFAULT_CMD_GRACE_MS;
+	cfg_p->cmdMax = DEFAULT_CMD_MAX;
+	cfg_p->rtCpu = -1;
+
+	lineCnt = 0;
+	while ((nread = getline(&line, &len, stream)) != -1) {
+		++lineCnt;
+
+		log_debug("config[%03d]: %s", lineCnt, line);
+
+		// skip blank lines and lines starting with '#'
+		if (line[0] == '#') {
+			log_debug(" skipping comment\n");
+			continue;
+		}
+		if (line[0] == '\n') {
+			log_debug(" skipping empty line\n");
+			continue;
+		}
+
+		token = strtok(line, delim);
+		if (token == NULL) {
+			log_err("   invalid config line #%d: no CMD\n", lineCnt);
+			continue;
+		}
+
+		// MQTT
+		if ((strcmp(token, "MQTT") == 0) || (strcmp(token, "BROKER") == 0)) {
+			log_info("found a broker (%s)\n", token);
+
+			// MQTT sets up the default broker, BROKER a named one
+			if (strcmp(token, "BROKER") == 0) {
+				token = strtok(NULL, delim);
+				if (token == NULL) {
+					log_err("   invalid config line #%d: broker name expected\n", lineCnt);
+					goto error;
+				}
+				if (find_broker(cfg_p, token) >= 0) {
+					log_err("   invalid config line #%d: broker '%s' already defined\n", lineCnt, token);
+					goto error;
+				}
+				name_p = token;
+			}
+			else
+				name_p = DEFAULT_BROKER_NAME;
+
+			i = find_broker(cfg_p, name_p);
+			if (i < 0) {
+				cfg_p->brokerInfo = (BROKERinfo_t*)realloc(cfg_p->brokerInfo,
+						((cfg_p->brokerInfoCnt+1) * sizeof(BROKERinfo_t)));
+				if (cfg_p->brokerInfo == NULL) {
+					perror("realloc(broker)");
+					exit(EXIT_FAILURE);
+				}
+				i = cfg_p->brokerInfoCnt++;
+				memset(&cfg_p->brokerInfo[i], 0, sizeof(BROKERinfo_t));
+				cfg_p->brokerInfo[i].loop.epollFd = -1;
+				cfg_p->brokerInfo[i].brokerName = strdup(name_p);
+				if (cfg_p->brokerInfo[i].brokerName == NULL) {
+					perror("strdup(broker name)");
+					exit(EXIT_FAILURE);
+				}
+			}
+			broker_p = &cfg_p->brokerInfo[i];
+			log_info("   broker: %s\n", broker_p->brokerName);
+
+			// server DNS/IP
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: MQTT server DNS/IP expected\n", lineCnt);
+				goto error;
+			}
+			log_info("   MQTT server DNS/IP: %s\n", token);
+			free(broker_p->server);
+			broker_p->server = strdup(token);
+			if (broker_p->server == NULL) {
+				perror("strdup(MQTT server)");
+				exit(EXIT_FAILURE);
+			}
+
+			// server port
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: MQTT server port expected\n", lineCnt);
+				goto error;
+			}
+			broker_p->port = atoi(token);
+			log_info("   MQTT port: %d\n", broker_p->port);
+
+			// optional client ID, asks for a persistent session
+			free(broker_p->clientId);
+			broker_p->clientId = NULL;
+			token = strtok(NULL, delim);
+			if (token != NULL) {
+				log_info("   MQTT client ID: %s\n", token);
+				broker_p->clientId = strdup(token);
+				if (broker_p->clientId == NULL) {
+					perror("strdup(MQTT client ID)");
+					exit(EXIT_FAILURE);
+				}
+			}
+
+			continue;
+		}
+
+		// GPIO
+		if (strcmp(token, "GPIO") == 0) {
+			log_debug(" found a GPIO (cnt:%u)\n", cfg_p->gpioInfoCnt);
+
+			if ((cfg_p->gpioInfoCnt+1) == INT_MAX) {
+				log_warning("   no more room in GPIO table, not added\n");
+				continue;
+			}
+			cfg_p->gpioInfo = (GPIOinfo_t*)grow_table(cfg_p->gpioInfo, cfg_p->gpioInfoCnt, sizeof(GPIOinfo_t), "GPIO");
+			gpio_p = &cfg_p->gpioInfo[cfg_p->gpioInfoCnt++];
+			memset(gpio_p, 0, sizeof(GPIOinfo_t));
+			log_debug("   realloc(GPIO)'ed\n");
+
+			// gpio name
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: gpio name expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   gpio name: %s\n", token);
+			gpio_p->gpioName = arena_intern(&cfg_p->arena, token);
+
+			// chip
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: chip expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   chip: %s\n", token);
+			gpio_p->chipStr = arena_intern(&cfg_p->arena, token);
+
+			// pin
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: pin expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   pin: %s\n", token);
+			gpio_p->pin = atoi(token);
+
+			// state topic and its broker [optional, any order]
+			for (token = strtok(NULL, delim); token != NULL; token = strtok(NULL, delim)) {
+				log_debug("   option: %s\n", token);
+				if ((strncmp(token, "STATE=", 6) == 0) && (token[6] != 0) && (gpio_p->stateTopic == NULL)) {
+					gpio_p->stateTopic = arena_intern(&cfg_p->arena, token + 6);
+				}
+				else if ((strncmp(token, "BROKER=", 7) == 0) && (token[7] != 0) && (gpio_p->brokerName == NULL)) {
+					gpio_p->brokerName = arena_intern(&cfg_p->arena, token + 7);
+				}
+				else {
+					log_err("   invalid config line #%d: unknown GPIO option '%s'\n", lineCnt, token);
+					goto error;
+				}
+			}
+
+			continue;
+		}
+
+		// CMD
+		if (strcmp(token, "CMD") == 0) {
+			log_debug(" found a CMD (cnt:%u)\n", cfg_p->cmdInfoCnt);
+
+			if ((cfg_p->cmdInfoCnt+1) == INT_MAX) {
+				log_warning("  no more room in CMD table, not added\n");
+				continue;
+			}
+			cfg_p->cmdInfo = (CMDinfo_t*)grow_table(cfg_p->cmdInfo, cfg_p->cmdInfoCnt, sizeof(CMDinfo_t), "CMD");
+			cmd_p = &cfg_p->cmdInfo[cfg_p->cmdInfoCnt++];
+			memset(cmd_p, 0, sizeof(CMDinfo_t));
+			log_debug("  realloc(CMD)'ed\n");
+
+			// action name
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: cmd name expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   cmd name: %s\n", token);
+			cmd_p->actionName = arena_intern(&cfg_p->arena, token);
+
+			// options [any order], then the cmd to run (read up to the end
+			// of the line); a token that looks like an option but isn't a
+			// valid one is an error, not the program's name
+			for (token = strtok(NULL, delim); token != NULL; token = strtok(NULL, delim)) {
+				if (strcmp(token, "PERSISTENT") == 0)
+					cmd_p->persistent = true;
+				else if (strncmp(token, "MAX=", 4) == 0) {
+					if (!parse_int(token + 4, 1, INT_MAX, &cmd_p->maxChildren)) {
+						log_err("   invalid config line #%d: MAX=<n> (n > 0) expected\n", lineCnt);
+						goto error;
+					}
+				}
+				else if (strncmp(token, "QUEUE=", 6) == 0) {
+					if (!parse_int(token + 6, 1, INT_MAX, &cmd_p->queueMax)) {
+						log_err("   invalid config line #%d: QUEUE=<n> (n > 0) expected\n", lineCnt);
+						goto error;
+					}
+				}
+				else if (strcmp(token, "RESTART") == 0)
+					cmd_p->restart = true;
+				else if (strncmp(token, "REPLY=", 6) == 0) {
+					if ((token[6] == 0) || (cmd_p->replyTopic != NULL)) {
+						log_err("   invalid config line #%d: one REPLY=<mqtt topic> expected\n", lineCnt);
+						goto error;
+					}
+					cmd_p->replyTopic = arena_intern(&cfg_p->arena, token + 6);
+				}
+				else if (strncmp(token, "BROKER=", 7) == 0) {
+					if ((token[7] == 0) || (cmd_p->brokerName != NULL)) {
+						log_err("   invalid config line #%d: one BROKER=<BROKERname> expected\n", lineCnt);
+						goto error;
+					}
+					cmd_p->brokerName = arena_intern(&cfg_p->arena, token + 7);
+				}
+				else
+					break;
+				log_debug("   option: %s\n", token);
+			}
+			if (token == NULL) {
+				log_err("   invalid config line #%d: cmd to run expected\n", lineCnt);
+				goto error;
+			}
+			if (((cmd_p->replyTopic != NULL) || (cmd_p->brokerName != NULL)) && !cmd_p->persistent) {
+				log_err("   invalid config line #%d: REPLY= and BROKER= need PERSISTENT\n", lineCnt);
+				goto error;
+			}
+			if (cmd_p->persistent && ((cmd_p->maxChildren != 0) || (cmd_p->queueMax != 0) || cmd_p->restart)) {
+				log_err("   invalid config line #%d: a PERSISTENT CMD has one process, MAX=, QUEUE= and RESTART don't apply\n", lineCnt);
+				goto error;
+			}
+			if ((cmd_p->queueMax != 0) && cmd_p->restart) {
+				log_err("   invalid config line #%d: QUEUE= and RESTART are exclusive\n", lineCnt);
+				goto error;
+			}
+			if (cmd_p->maxChildren == 0)
+				cmd_p->maxChildren = 1;
+
+			// strtok() ended the program's name, put the blank back if
+			// there are arguments after it
+			if (strtok(NULL, "\n") != NULL)
+				token[strlen(token)] = ' ';
+			cmd_p->cmdStr = arena_intern(&cfg_p->arena, token);
+
+			continue;
+		}
+
+		// INPUT
+		if (strcmp(token, "INPUT") == 0) {
+			log_debug(" found an INPUT (cnt:%u)\n", cfg_p->inputInfoCnt);
+
+			if ((cfg_p->inputInfoCnt+1) == INT_MAX) {
+				log_warning("   no more room in INPUT table, not added\n");
+				continue;
+			}
+			cfg_p->inputInfo = (INPUTinfo_t*)grow_table(cfg_p->inputInfo, cfg_p->inputInfoCnt, sizeof(INPUTinfo_t), "INPUT");
+			input_p = &cfg_p->inputInfo[cfg_p->inputInfoCnt++];
+			memset(input_p, 0, sizeof(INPUTinfo_t));
+			log_debug("   realloc(INPUT)'ed\n");
+
+			// input name
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: input name expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   input name: %s\n", token);
+			input_p->inputName = arena_intern(&cfg_p->arena, token);
+
+			// chip
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: chip expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   chip: %s\n", token);
+			input_p->chipStr = arena_intern(&cfg_p->arena, token);
+
+			// pin
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: pin expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   pin: %s\n", token);
+			input_p->pin = atoi(token);
+
+			// debounce [optional]
+			token = strtok(NULL, delim);
+			if (token != NULL) {
+				if (!parse_int(token, 0, INT_MAX, &input_p->debounceMs)) {
+					log_err("   invalid config line #%d: debounce (ms >= 0) expected\n", lineCnt);
+					goto error;
+				}
+				log_debug("   debounce: %dms\n", input_p->debounceMs);
+			}
+
+			continue;
+		}
+
+		// PUB
+		if (strcmp(token, "PUB") == 0) {
+			log_debug(" found a PUB (cnt:%u)\n", cfg_p->pubInfoCnt);
+
+			if ((cfg_p->pubInfoCnt+1) == INT_MAX) {
+				log_warning("   no more room in PUB table, not added\n");
+				continue;
+			}
+			cfg_p->pubInfo = (PUBinfo_t*)grow_table(cfg_p->pubInfo, cfg_p->pubInfoCnt, sizeof(PUBinfo_t), "PUB");
+			pub_p = &cfg_p->pubInfo[cfg_p->pubInfoCnt++];
+			memset(pub_p, 0, sizeof(PUBinfo_t));
+			log_debug("   realloc(PUB)'ed\n");
+
+			// topic
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: topic expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   topic: %s\n", token);
+			pub_p->topicStr = arena_intern(&cfg_p->arena, token);
+
+			// input name
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: input name expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   input name: %s\n", token);
+			pub_p->inputName = arena_intern(&cfg_p->arena, token);
+
+			// qos
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 0, 2, &pub_p->qos)) {
+				log_err("   invalid config line #%d: qos (0-2) expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   qos: %d\n", pub_p->qos);
+
+			// INV and policy [optional, any order]
+			for (token = strtok(NULL, delim); token != NULL; token = strtok(NULL, delim)) {
+				log_debug("   option: %s\n", token);
+				if (strcmp(token, "INV") == 0)
+					pub_p->inv = true;
+				else if (strncmp(token, "COALESCE=", 9) == 0) {
+					if (!parse_int(token + 9, 0, INT_MAX, &pub_p->coalesceMs)) {
+						log_err("   invalid config line #%d: COALESCE=<ms> (ms >= 0) expected\n", lineCnt);
+						goto error;
+					}
+				}
+				else if (strncmp(token, "RATE=", 5) == 0) {
+					if (!parse_int(token + 5, 0, INT_MAX, &pub_p->rateMax)) {
+						log_err("   invalid config line #%d: RATE=<n> (n >= 0) expected\n", lineCnt);
+						goto error;
+					}
+				}
+				else if (strcmp(token, "COUNT") == 0)
+					pub_p->count = true;
+				else if ((strncmp(token, "BROKER=", 7) == 0) && (token[7] != 0) && (pub_p->brokerName == NULL)) {
+					pub_p->brokerName = arena_intern(&cfg_p->arena, token + 7);
+				}
+				else {
+					log_err("   invalid config line #%d: unknown PUB option: %s\n", lineCnt, token);
+					goto error;
+				}
+			}
+
+			continue;
+		}
+
+		// CMDGRACE
+		if (strcmp(token, "CMDGRACE") == 0) {
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 0, INT_MAX, &cfg_p->cmdGraceMs)) {
+				log_err("   invalid config line #%d: grace period (ms >= 0) expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   CMD grace period: %dms\n", cfg_p->cmdGraceMs);
+			continue;
+		}
+
+		// CMDMAX
+		if (strcmp(token, "CMDMAX") == 0) {
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 1, INT_MAX, &cfg_p->cmdMax)) {
+				log_err("   invalid config line #%d: number of processes expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   CMD processes: at most %d\n", cfg_p->cmdMax);
+			continue;
+		}
+
+		// REALTIME
+		if (strcmp(token, "REALTIME") == 0) {
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 1, 99, &cfg_p->rtPrio)) {
+				log_err("   invalid config line #%d: SCHED_FIFO priority (1-99) expected\n", lineCnt);
+				goto error;
+			}
+			token = strtok(NULL, delim);
+			if (token != NULL) {
+				if ((strncmp(token, "CPU=", 4) != 0) || !parse_int(token + 4, 0, INT_MAX, &cfg_p->rtCpu)) {
+					log_err("   invalid config line #%d: unknown REALTIME option '%s'\n", lineCnt, token);
+					goto error;
+				}
+			}
+			log_debug("   real-time: priority %d, cpu %d\n", cfg_p->rtPrio, cfg_p->rtCpu);
+			continue;
+		}
+
+		// SHARDS
+		if (strcmp(token, "SHARDS") == 0) {
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 1, SHARD_MAX, &cfg_p->shardCnt)) {
+				log_err("   invalid config line #%d: number of threads (1-%d) expected\n", lineCnt, SHARD_MAX);
+				goto error;
+			}
+			log_debug("   pins on %d thread(s)\n", cfg_p->shardCnt);
+			continue;
+		}
+
+		// STATS
+		if (strcmp(token, "STATS") == 0) {
+			token = strtok(NULL, delim);
+			if ((token == NULL) || (cfg_p->statsTopic != NULL)) {
+				log_err("   invalid config line #%d: one stats topic expected\n", lineCnt);
+				goto error;
+			}
+			cfg_p->statsTopic = arena_intern(&cfg_p->arena, token);
+
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 1, INT_MAX, &cfg_p->statsSec)) {
+				log_err("   invalid config line #%d: stats interval (s) expected\n", lineCnt);
+				goto error;
+			}
+
+			// broker [optional]
+			token = strtok(NULL, delim);
+			if (token != NULL) {
+				if ((strncmp(token, "BROKER=", 7) != 0) || (token[7] == 0)) {
+					log_err("   invalid config line #%d: unknown STATS option '%s'\n", lineCnt, token);
+					goto error;
+				}
+				cfg_p->statsBrokerName = arena_intern(&cfg_p->arena, token + 7);
+			}
+			log_debug("   stats: '%s' every %ds\n", cfg_p->statsTopic, cfg_p->statsSec);
+			continue;
+		}
+
+		// METRICS
+		if (strcmp(token, "METRICS") == 0) {
+			token = strtok(NULL, delim);
+			if ((token == NULL) || (cfg_p->metricsAddr != NULL)) {
+				log_err("   invalid config line #%d: one metrics [address:]port or socket path expected\n", lineCnt);
+				goto error;
+			}
+			cfg_p->metricsAddr = arena_intern(&cfg_p->arena, token);
+			log_debug("   metrics on: %s\n", cfg_p->metricsAddr);
+			continue;
+		}
+
+		// SUB
+		if (strcmp(token, "SUB") == 0) {
+			log_debug(" found a SUB (cnt:%u)\n", cfg_p->subInfoCnt);
+
+			if ((cfg_p->subInfoCnt+1) == INT_MAX) {
+				log_warning("   no more room in SUB table, not added\n");
+				continue;
+			}
+			cfg_p->subInfo = (SUBinfo_t*)grow_table(cfg_p->subInfo, cfg_p->subInfoCnt, sizeof(SUBinfo_t), "SUB");
+			sub_p = &cfg_p->subInfo[cfg_p->subInfoCnt++];
+			memset(sub_p, 0, sizeof(SUBinfo_t));
+			log_debug("   realloc(SUB)'ed\n");
+
+			// topic
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: topic expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   topic: %s\n", token);
+			sub_p->topicStr = arena_intern(&cfg_p->arena, token);
+
+			// gpio name
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: gpio name expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   gpio name: %s\n", token);
+			sub_p->gpioName = arena_intern(&cfg_p->arena, token);
+
+			// qos
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 0, 2, &sub_p->qos)) {
+				log_err("   invalid config line #%d: qos (0-2) expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   qos: %d\n", sub_p->qos);
+
+			// INV and broker [optional, any order]
+			for (token = strtok(NULL, delim); token != NULL; token = strtok(NULL, delim)) {
+				log_debug("   option: %s\n", token);
+				if ((strncmp(token, "BROKER=", 7) == 0) && (token[7] != 0) && (sub_p->brokerName == NULL)) {
+					sub_p->brokerName = arena_intern(&cfg_p->arena, token + 7);
+				}
+				else if (strcmp(token, "INV") == 0)
+					sub_p->inv = true;
+				else {
+					log_err("   invalid config line #%d: unknown SUB option: %s\n", lineCnt, token);
+					goto error;
+				}
+			}
+
+			continue;
+		}
+
+		// SCENE
+		if (strcmp(token, "SCENE") == 0) {
+			log_debug(" found a SCENE (cnt:%u)\n", cfg_p->sceneInfoCnt);
+
+			if ((cfg_p->sceneInfoCnt+1) == INT_MAX) {
+				log_warning("   no more room in SCENE table, not added\n");
+				continue;
+			}
+			cfg_p->sceneInfo = (SCENEinfo_t*)grow_table(cfg_p->sceneInfo, cfg_p->sceneInfoCnt, sizeof(SCENEinfo_t), "SCENE");
+			scene_p = &cfg_p->sceneInfo[cfg_p->sceneInfoCnt++];
+			memset(scene_p, 0, sizeof(SCENEinfo_t));
+			log_debug("   realloc(SCENE)'ed\n");
+
+			// topic
+			token = strtok(NULL, delim);
+			if (token == NULL) {
+				log_err("   invalid config line #%d: topic expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   topic: %s\n", token);
+			scene_p->topicStr = arena_intern(&cfg_p->arena, token);
+
+			// payload
+			token = strtok(NULL, delim);
+			if ((token == NULL) || (strlen(token) > SCENE_PAYLOAD_MAX)) {
+				log_err("   invalid config line #%d: payload (at most %d characters) expected\n", lineCnt, SCENE_PAYLOAD_MAX);
+				goto error;
+			}
+			log_debug("   payload: %s\n", token);
+			scene_p->payload = arena_intern(&cfg_p->arena, token);
+
+			// qos
+			token = strtok(NULL, delim);
+			if ((token == NULL) || !parse_int(token, 0, 2, &scene_p->qos)) {
+				log_err("   invalid config line #%d: qos (0-2) expected\n", lineCnt);
+				goto error;
+			}
+			log_debug("   qos: %d\n", scene_p->qos);
+
+			// <GPIOname>=<value> and broker [any order]
+			for (token = strtok(NULL, delim); token != NULL; token = strtok(NULL, delim)) {
+				log_debug("   option: %s\n", token);
+				if ((strncmp(token, "BROKER=", 7) == 0) && (token[7] != 0) && (scene_p->brokerName == NULL)) {
+					scene_p->brokerName = arena_intern(&cfg_p->arena, token + 7);
+					continue;
+				}
+				val_p = strchr(token, '=');
+				if ((val_p == NULL) || (val_p == token)) {
+					log_err("   invalid config line #%d: unknown SCENE option '%s'\n", lineCnt, token);
+					goto error;
+				}
+				*val_p++ = 0;
+				scene_p->set = (SCENEset_t*)grow_table(scene_p->set, scene_p->setCnt, sizeof(SCENEset_t), "SCENE set");
+				set_p = &scene_p->set[scene_p->setCnt++];
+				set_p->gpioName = arena_intern(&cfg_p->arena, token);
+				if ((strcasecmp(val_p, "ON") == 0) || (strcmp(val_p, "1") == 0))
+					set_p->val = 1;
+				else if ((strcasecmp(val_p, "OFF") == 0) || (strcmp(val_p, "0") == 0))
+					set_p->val = 0;
+				else {
+					log_err("   invalid config line #%d: '%s' needs ON or OFF, not '%s'\n", lineCnt, token, val_p);
+					goto error;
+				}
+			}
+			if (scene_p->setCnt == 0) {
+				log_err("   invalid config line #%d: <GPIOname>=<ON|OFF> expected\n", lineCnt);
+				goto error;
+			}
+
+			continue;
+		}
+
+		log_err("   invalid config line #%d: unknown CMD: %s\n", lineCnt, token);
+		goto error;
+	}
+
+	free(line);
+	fclose(stream);
+	pack_tables(cfg_p);
+	return true;
+
+error:
+	free(line);
+	fclose(stream);
+	pack_tables(cfg_p);
+	return false;
+}
+
+// the tables were grown on the heap while the file was read, they go into
+// the arena back to back
+static void
+pack_tables (CONFIG_t *cfg_p)
+{
+	int i;
+
+	cfg_p->gpioInfo = (GPIOinfo_t*)arena_pack(&cfg_p->arena, cfg_p->gpioInfo, cfg_p->gpioInfoCnt * sizeof(GPIOinfo_t));
+	cfg_p->subInfo = (SUBinfo_t*)arena_pack(&cfg_p->arena, cfg_p->subInfo, cfg_p->subInfoCnt * sizeof(SUBinfo_t));
+	cfg_p->sceneInfo = (SCENEinfo_t*)arena_pack(&cfg_p->arena, cfg_p->sceneInfo, cfg_p->sceneInfoCnt * sizeof(SCENEinfo_t));
+	for (i=0; i<cfg_p->sceneInfoCnt; ++i)
+		cfg_p->sceneInfo[i].set = (SCENEset_t*)arena_pack(&cfg_p->arena, cfg_p->sceneInfo[i].set,
+				cfg_p->sceneInfo[i].setCnt * sizeof(SCENEset_t));
+	cfg_p->cmdInfo = (CMDinfo_t*)arena_pack(&cfg_p->arena, cfg_p->cmdInfo, cfg_p->cmdInfoCnt * sizeof(CMDinfo_t));
+	cfg_p->inputInfo = (INPUTinfo_t*)arena_pack(&cfg_p->arena, cfg_p->inputInfo, cfg_p->inputInfoCnt * sizeof(INPUTinfo_t));
+	cfg_p->pubInfo = (PUBinfo_t*)arena_pack(&cfg_p->arena, cfg_p->pubInfo, cfg_p->pubInfoCnt * sizeof(PUBinfo_t));
+}
+
+// the compiled image if there is one and it was made from this very text,
+// else the text
+bool
+read_config (const char *fileName_p, CONFIG_t *cfg_p)
+{
+	if ((fileName_p != NULL) && load_config_image(fileName_p, cfg_p))
+		return true;
+	return process_config_file(fileName_p, cfg_p);
+}
+
+// what startup would only warn about is an error here
+bool
+validate_config (CONFIG_t *cfg_p)
+{
+	int i, j, k, errCnt = 0;
+	size_t len;
+	uint32_t size, slot;
+	int *pins;
+	int total = cfg_p->gpioInfoCnt + cfg_p->inputInfoCnt;
+	const char *chip_p, *other_p;
+	int pin, otherPin;
+	char path[PATH_MAX];
+
+	if (cfg_p->brokerInfoCnt == 0) {
+		log_err("no MQTT broker configured\n");
+		++errCnt;
+	}
+
+	for (i=0; i<cfg_p->gpioInfoCnt; ++i)
+		if ((cfg_p->gpioInfo[i].stateTopic != NULL)
+				&& (resolve_broker(cfg_p, cfg_p->gpioInfo[i].brokerName, cfg_p->gpioInfo[i].stateTopic) < 0))
+			++errCnt;
+	for (i=0; i<cfg_p->pubInfoCnt; ++i) {
+		if (resolve_broker(cfg_p, cfg_p->pubInfo[i].brokerName, cfg_p->pubInfo[i].topicStr) < 0)
+			++errCnt;
+		for (j=0; j<cfg_p->inputInfoCnt; ++j)
+			if (cfg_p->pubInfo[i].inputName == cfg_p->inputInfo[j].inputName)
+				break;
+		if (j == cfg_p->inputInfoCnt) {
+			log_err("PUB[%d] '%s': no INPUT named '%s'\n", i, cfg_p->pubInfo[i].topicStr, cfg_p->pubInfo[i].inputName);
+			++errCnt;
+		}
+	}
+	if ((cfg_p->statsTopic != NULL) && (resolve_broker(cfg_p, cfg_p->statsBrokerName, cfg_p->statsTopic) < 0))
+		++errCnt;
+	for (i=0; i<cfg_p->subInfoCnt; ++i) {
+		if (resolve_broker(cfg_p, cfg_p->subInfo[i].brokerName, cfg_p->subInfo[i].topicStr) < 0)
+			++errCnt;
+		for (j=0; j<cfg_p->gpioInfoCnt; ++j)
+			if (cfg_p->subInfo[i].gpioName == cfg_p->gpioInfo[j].gpioName)
+				break;
+		if (j < cfg_p->gpioInfoCnt)
+			continue;
+		for (j=0; j<cfg_p->cmdInfoCnt; ++j)
+			if (cfg_p->subInfo[i].gpioName == cfg_p->cmdInfo[j].actionName)
+				break;
+		if (j == cfg_p->cmdInfoCnt) {
+			log_err("SUB[%d] '%s': no GPIO or CMD named '%s'\n", i, cfg_p->subInfo[i].topicStr, cfg_p->subInfo[i].gpioName);
+			++errCnt;
+		}
+	}
+	for (i=0; i<cfg_p->sceneInfoCnt; ++i) {
+		if (resolve_broker(cfg_p, cfg_p->sceneInfo[i].brokerName, cfg_p->sceneInfo[i].topicStr) < 0)
+			++errCnt;
+		for (k=0; k<cfg_p->sceneInfo[i].setCnt; ++k) {
+			for (j=0; j<cfg_p->gpioInfoCnt; ++j)
+				if (cfg_p->sceneInfo[i].set[k].gpioName == cfg_p->gpioInfo[j].gpioName)
+					break;
+			if (j == cfg_p->gpioInfoCnt) {
+				log_err("SCENE[%d] '%s' %s: no GPIO named '%s'\n", i, cfg_p->sceneInfo[i].topicStr,
+						cfg_p->sceneInfo[i].payload, cfg_p->sceneInfo[i].set[k].gpioName);
+				++errCnt;
+			}
+		}
+	}
+
+	for (i=0; i<cfg_p->cmdInfoCnt; ++i) {
+		if ((cfg_p->cmdInfo[i].replyTopic != NULL)
+				&& (resolve_broker(cfg_p, cfg_p->cmdInfo[i].brokerName, cfg_p->cmdInfo[i].replyTopic) < 0))
+			++errCnt;
+		len = strcspn(cfg_p->cmdInfo[i].cmdStr, " \t\n");
+		if ((len == 0) || (len >= sizeof(path))) {
+			log_err("CMD '%s': nothing to run\n", cfg_p->cmdInfo[i].actionName);
+			++errCnt;
+			continue;
+		}
+		memcpy(path, cfg_p->cmdInfo[i].cmdStr, len);
+		path[len] = 0;
+		if (!cmd_runnable(cfg_p->cmdInfo[i].actionName, path))
+			++errCnt;
+	}
+
+	// a (chip, pin) may only be used once by the GPIOs and INPUTs
+	// together; chips are compared by the name given, the aliases of a
+	// chip aren't known without opening it
+	size = 2;
+	while (size < (uint32_t)total * 2)
+		size <<= 1;
+	pins = (int*)malloc(size * sizeof(int));
+	if (pins == NULL) {
+		perror("malloc(pins)");
+		return false;
+	}
+	for (slot=0; slot<size; ++slot)
+		pins[slot] = -1;
+	for (i=0; i<total; ++i) {
+		chip_p = (i < cfg_p->gpioInfoCnt)? cfg_p->gpioInfo[i].chipStr : cfg_p->inputInfo[i - cfg_p->gpioInfoCnt].chipStr;
+		pin = (i < cfg_p->gpioInfoCnt)? cfg_p->gpioInfo[i].pin : cfg_p->inputInfo[i - cfg_p->gpioInfoCnt].pin;
+		for (slot = (hash_str(chip_p) ^ ((uint32_t)pin * 2654435761u)) & (size - 1); pins[slot] != -1; slot = (slot + 1) & (size - 1)) {
+			j = pins[slot];
+			other_p = (j < cfg_p->gpioInfoCnt)? cfg_p->gpioInfo[j].chipStr : cfg_p->inputInfo[j - cfg_p->gpioInfoCnt].chipStr;
+			otherPin = (j < cfg_p->gpioInfoCnt)? cfg_p->gpioInfo[j].pin : cfg_p->inputInfo[j - cfg_p->gpioInfoCnt].pin;
+			if ((other_p == chip_p) && (otherPin == pin)) {
+				log_err("'%s': chip %s pin %d is already used by '%s'\n",
+						(i < cfg_p->gpioInfoCnt)? cfg_p->gpioInfo[i].gpioName : cfg_p->inputInfo[i - cfg_p->gpioInfoCnt].inputName,
+						chip_p, pin,
+						(j < cfg_p->gpioInfoCnt)? cfg_p->gpioInfo[j].gpioName : cfg_p->inputInfo[j - cfg_p->gpioInfoCnt].inputName);
+				++errCnt;
+				break;
+			}
+		}
+		if (pins[slot] == -1)
+			pins[slot] = i;
+	}
+	free(pins);
+
+	if (errCnt > 0)
+		log_err("%d problem(s) in the config, not compiled\n", errCnt);
+	return errCnt == 0;
+}
+
+bool
+cmd_runnable (const char *name_p, const char *path_p)
+{
+	struct stat statInfo;
+
+	if (stat(path_p, &statInfo) != 0) {
+		log_warning("CMD '%s': can't stat %s, marked invalid\n", name_p, path_p);
+		return false;
+	}
+	if (!S_ISREG(statInfo.st_mode)) {
+		log_warning("CMD '%s': %s is not a regular file, marked invalid\n", name_p, path_p);
+		return false;
+	}
+	if (!(statInfo.st_mode & S_IXOTH)) {
+		log_warning("CMD '%s': %s is not executable, marked invalid\n", name_p, path_p);
+		return false;
+	}
+	return true;
+}
+
+// a whole token of decimal digits (with an optional sign) in min..max
+static bool
+parse_int (const char *str_p, int min, int max, int *val_p)
+{
+	long val;
+	char *end_p;
+
+	errno = 0;
+	val = strtol(str_p, &end_p, 10);
+	if ((errno != 0) || (end_p == str_p) || (*end_p != 0) || (val < min) || (val > max))
+		return false;
+	*val_p = (int)val;
+	return true;
+}
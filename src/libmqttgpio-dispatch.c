@@ -0,0 +1,1119 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// the message path: a broker thread decodes and queues, the main loop
+// (and with SHARDS each shard thread) walks the queue, matches the topic
+// against the SUB trie, stages the pins and writes each chip once
+
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "libmqttgpio-int.h"
+
+static uint32_t hash_level (int parent, const char *level_p, size_t len);
+static void match_topic (const CONFIG_t *cfg_p, int node, const char *level_p, bool first, int *match_p, int *cnt_p);
+static void match_last (const CONFIG_t *cfg_p, int node, int *match_p, int *cnt_p);
+static void set_gpio (MQTTGPIO_t *ctx_p, int gpio, int val);
+static void note_state (MQTTGPIO_t *ctx_p, int gpio);
+static void mark_dirty (MQTTGPIO_t *ctx_p, int bulk);
+static void apply_scene (MQTTGPIO_t *ctx_p, SHARD_t *shard_p, const SCENEinfo_t *scene_p);
+static int get_gpio (MQTTGPIO_t *ctx_p, int gpio);
+static void flush_gpios (MQTTGPIO_t *ctx_p, SHARD_t *shard_p);
+static void publish_states (MQTTGPIO_t *ctx_p, SHARD_t *shard_p, int brokerIdx);
+static void *shard_thread (void *data_p);
+static void shard_wake_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void shard_flush (MQTTGPIO_t *ctx_p, SHARD_t *shard_p);
+static void stats_message (MQTTGPIO_t *ctx_p, uint64_t recvNs, int matchCnt);
+static void revert_fire (MQTTGPIO_t *ctx_p, WHEELnode_t *node_p);
+static void revert_done (MQTTGPIO_t *ctx_p, WHEEL_t *wheel_p);
+static bool queue_message (BROKERinfo_t *broker_p, const char *topic_p, const char *payload_p, size_t payloadLen);
+static int parse_payload (const char *p, size_t len, uint32_t *durMs_p);
+static int parse_json_state (const char *p, const char *end_p, uint32_t *durMs_p);
+static bool parse_duration (const char *p, const char *end_p, uint32_t scale, uint32_t *durMs_p);
+static size_t ring_fill (RING_t *ring_p);
+static void ring_walk (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p, SHARD_t *shard_p, size_t end, uint64_t atNs);
+static int apply_message (MQTTGPIO_t *ctx_p, int brokerIdx, SHARD_t *shard_p, const char *topic_p, int val, uint32_t durMs,
+		const char *payload_p, size_t payloadLen, bool *pins_p);
+static void apply_connect (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p, bool sessionPresent);
+
+// the chips are dealt out to the shards as they're opened; a shard with
+// a thread has a loop of its own (its wheel runs there), woken along with
+// the main loop whenever a broker has queued something
+void
+init_shards (MQTTGPIO_t *ctx_p)
+{
+	int i, fd;
+	SHARD_t *shard_p;
+
+	ctx_p->sharded = (ctx_p->cfg->shardCnt > 0);
+	ctx_p->shardCnt = ctx_p->sharded? ctx_p->cfg->shardCnt : 1;
+	ctx_p->shard = (SHARD_t*)calloc(ctx_p->shardCnt, sizeof(SHARD_t));
+	if (ctx_p->shard == NULL) {
+		perror("calloc(shard)");
+		exit(EXIT_FAILURE);
+	}
+	if (sched_getaffinity(0, sizeof(ctx_p->shardCpus), &ctx_p->shardCpus) != 0) {
+		perror("sched_getaffinity()");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i)
+		ctx_p->cfg->brokerInfo[i].ring.shardCnt = ctx_p->sharded? ctx_p->shardCnt : 0;
+
+	for (i=0; i<ctx_p->shardCnt; ++i) {
+		shard_p = &ctx_p->shard[i];
+		shard_p->shardIdx = i;
+		shard_p->loop.epollFd = -1;
+		shard_p->loop_p = &ctx_p->mainLoop;
+		if (ctx_p->sharded) {
+			shard_p->loop.ctx_p = ctx_p;
+			shard_p->loop.epollFd = epoll_create1(EPOLL_CLOEXEC);
+			if (shard_p->loop.epollFd < 0) {
+				perror("epoll_create1()");
+				exit(EXIT_FAILURE);
+			}
+			fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (fd < 0) {
+				perror("eventfd()");
+				exit(EXIT_FAILURE);
+			}
+			shard_p->wakeWatch_p = loop_add(&shard_p->loop, fd, EPOLLIN, shard_wake_cb, shard_p);
+			shard_p->loop_p = &shard_p->loop;
+		}
+		wheel_init(&shard_p->wheel, shard_p->loop_p, revert_fire, revert_done);
+
+		// a pass sees at most a ring's worth of records per broker
+		shard_p->batchEnd = (size_t*)calloc(ctx_p->cfg->brokerInfoCnt + 1, sizeof(size_t));
+		shard_p->pinRecvNs = (uint64_t*)malloc((ctx_p->cfg->brokerInfoCnt * (ACTION_RING_SIZE / RING_REC_MIN) + 1)
+				* sizeof(uint64_t));
+		if ((shard_p->batchEnd == NULL) || (shard_p->pinRecvNs == NULL)) {
+			perror("malloc(shard)");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (ctx_p->sharded)
+		log_notice("pins on %d shard thread(s)\n", ctx_p->shardCnt);
+}
+
+// with SCHED_FIFO at the main loop's priority if it has it, but not on
+// its CPU; signals stay with the main loop
+void
+start_shards (MQTTGPIO_t *ctx_p)
+{
+	int i, ret;
+	uint64_t one = 1;
+	sigset_t all, old;
+	pthread_attr_t attr;
+	struct sched_param param;
+	SHARD_t *shard_p;
+
+	for (i=0; ctx_p->sharded && (i<ctx_p->shardCnt); ++i) {
+		shard_p = &ctx_p->shard[i];
+		if (shard_p->threadStarted)
+			continue;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(ctx_p->shardCpus), &ctx_p->shardCpus);
+		if (ctx_p->rtActive) {
+			memset(&param, 0, sizeof(param));
+			param.sched_priority = ctx_p->rtActivePrio;
+			pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+			pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+			pthread_attr_setschedparam(&attr, &param);
+		}
+
+		shard_p->loop.quit = false;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		ret = pthread_create(&shard_p->thread, &attr, shard_thread, shard_p);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		pthread_attr_destroy(&attr);
+		if (ret != 0) {
+			log_err("can't start thread for shard %d: %s\n", i, strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+		shard_p->threadStarted = true;
+
+		// whatever was queued while it wasn't running
+		if (write(shard_p->wakeWatch_p->fd, &one, sizeof(one)) != sizeof(one))
+			perror("write(shard)");
+	}
+}
+
+// stop and join the shard threads, what they were in the middle of is
+// finished first
+void
+stop_shards (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	uint64_t one = 1;
+	SHARD_t *shard_p;
+
+	for (i=0; ctx_p->sharded && (i<ctx_p->shardCnt); ++i) {
+		shard_p = &ctx_p->shard[i];
+		if (!shard_p->threadStarted)
+			continue;
+		shard_p->loop.quit = true;
+		if (write(shard_p->wakeWatch_p->fd, &one, sizeof(one)) != sizeof(one))
+			perror("write(shard)");
+		pthread_join(shard_p->thread, NULL);
+		shard_p->threadStarted = false;
+	}
+}
+
+static void *
+shard_thread (void *data_p)
+{
+	SHARD_t *shard_p = (SHARD_t*)data_p;
+
+	loop_run(&shard_p->loop);
+	return NULL;
+}
+
+// a shard's pass: everything queued on every broker since its last one,
+// its own pins only, then its writes; the room is given back last
+static void
+shard_wake_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	int i;
+	uint64_t cnt, atNs;
+	SHARD_t *shard_p = (SHARD_t*)data_p;
+	BROKERinfo_t *broker_p;
+
+	while (read(shard_p->wakeWatch_p->fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+		;
+
+	atNs = now_ns();
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		shard_p->batchEnd[i] = atomic_load_explicit(&broker_p->ring.head, memory_order_acquire);
+		ring_walk(ctx_p, broker_p, shard_p, shard_p->batchEnd[i], atNs);
+	}
+
+	shard_flush(ctx_p, shard_p);
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i)
+		atomic_store_explicit(&ctx_p->cfg->brokerInfo[i].ring.shardTail[shard_p->shardIdx], shard_p->batchEnd[i],
+				memory_order_release);
+}
+
+// write what the pass staged, then it's arrival to pins for each message
+// that reached them
+static void
+shard_flush (MQTTGPIO_t *ctx_p, SHARD_t *shard_p)
+{
+	int i;
+	uint64_t nowNs;
+
+	flush_gpios(ctx_p, shard_p);
+	nowNs = now_ns();
+	for (i=0; i<shard_p->pinRecvCnt; ++i)
+		hist_add(&ctx_p->stageHist[STAT_PIN], nowNs - shard_p->pinRecvNs[i]);
+	shard_p->pinRecvCnt = 0;
+}
+
+void
+shard_counts (MQTTGPIO_t *ctx_p, unsigned long *pinSkip_p, unsigned long *writeSkip_p)
+{
+	int i;
+
+	*pinSkip_p = *writeSkip_p = 0;
+	for (i=0; i<ctx_p->shardCnt; ++i) {
+		*pinSkip_p += atomic_load_explicit(&ctx_p->shard[i].pinSkipCnt, memory_order_relaxed);
+		*writeSkip_p += atomic_load_explicit(&ctx_p->shard[i].writeSkipCnt, memory_order_relaxed);
+	}
+}
+
+void
+hist_add (HIST_t *hist_p, uint64_t ns)
+{
+	int msb;
+	unsigned idx;
+	unsigned long max, us = (unsigned long)(ns / 1000);
+
+	if (us < 4)
+		idx = us;
+	else {
+		msb = 63 - __builtin_clzll(us);
+		idx = (msb - 1) * 4 + ((us >> (msb - 2)) & 3);
+		if (idx >= HIST_BUCKETS)
+			idx = HIST_BUCKETS - 1;
+	}
+	atomic_fetch_add_explicit(&hist_p->cnt[idx], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&hist_p->sum, us, memory_order_relaxed);
+
+	max = atomic_load_explicit(&hist_p->max, memory_order_relaxed);
+	while ((us > max) && !atomic_compare_exchange_weak_explicit(&hist_p->max, &max, us,
+				memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+// after a message's CMD pass, everything it asked for is done (with
+// SHARDS, everything but the pins, which are timed by their shards)
+static void
+stats_message (MQTTGPIO_t *ctx_p, uint64_t recvNs, int matchCnt)
+{
+	int m;
+	uint64_t ns = now_ns() - recvNs;
+
+	hist_add(&ctx_p->stageHist[STAT_TOTAL], ns);
+	for (m=0; m<matchCnt; ++m)
+		hist_add(&ctx_p->cfg->topicInfo[ctx_p->cfg->matchBuf[m]].hist, ns);
+}
+
+static void
+revert_fire (MQTTGPIO_t *ctx_p, WHEELnode_t *node_p)
+{
+	GPIOinfo_t *gpio_p = (GPIOinfo_t*)((char*)node_p - offsetof(GPIOinfo_t, revert));
+
+	log_info("timed: setting gpio chip %s pin %d back to %d\n", gpio_p->chipStr, gpio_p->pin, gpio_p->revertVal);
+	set_gpio(ctx_p, gpio_p - ctx_p->cfg->gpioInfo, gpio_p->revertVal);
+}
+
+// a shard's set-backs are written together, on its thread
+static void
+revert_done (MQTTGPIO_t *ctx_p, WHEEL_t *wheel_p)
+{
+	flush_gpios(ctx_p, (SHARD_t*)((char*)wheel_p - offsetof(SHARD_t, wheel)));
+}
+
+// FNV-1a
+uint32_t
+hash_str (const char *str_p)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*str_p != 0) {
+		hash ^= (unsigned char)*str_p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// returns the topicInfo index for this exact topic on this broker, or -1
+int
+lookup_topic (const CONFIG_t *cfg_p, int brokerIdx, const char *topic_p)
+{
+	uint32_t hash, slot;
+	int idx;
+
+	if (cfg_p->topicHash == NULL)
+		return -1;
+
+	hash = hash_str(topic_p) ^ (uint32_t)brokerIdx;
+	slot = hash & cfg_p->topicHashMask;
+	while ((idx = cfg_p->topicHash[slot]) != -1) {
+		if ((cfg_p->topicInfo[idx].hash == hash) && (cfg_p->topicInfo[idx].brokerIdx == brokerIdx)
+				&& (strcmp(cfg_p->topicInfo[idx].topicStr, topic_p) == 0))
+			return idx;
+		slot = (slot + 1) & cfg_p->topicHashMask;
+	}
+	return -1;
+}
+
+static uint32_t
+hash_level (int parent, const char *level_p, size_t len)
+{
+	uint32_t hash = 2166136261u ^ (uint32_t)parent;
+	size_t i;
+
+	for (i=0; i<len; ++i) {
+		hash ^= (unsigned char)level_p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// the child of 'node' for one level of a topic (or filter), -1 if there's
+// none and 'create' isn't set
+int
+trie_child (CONFIG_t *cfg_p, int node, const char *level_p, size_t len, bool create)
+{
+	int *child_p;
+	uint32_t hash, slot;
+	TRIEedge_t *edge_p;
+
+	if (create && (len == 1) && ((level_p[0] == '+') || (level_p[0] == '#')))
+		child_p = (level_p[0] == '+')? &cfg_p->trieNode[node].plusChild : &cfg_p->trieNode[node].hashChild;
+	else {
+		hash = hash_level(node, level_p, len);
+		slot = hash & cfg_p->trieEdgeMask;
+		for (edge_p = &cfg_p->trieEdge[slot]; edge_p->child != -1; edge_p = &cfg_p->trieEdge[slot]) {
+			if ((edge_p->hash == hash) && (edge_p->parent == node) && (edge_p->len == len)
+					&& (memcmp(edge_p->level_p, level_p, len) == 0))
+				return edge_p->child;
+			slot = (slot + 1) & cfg_p->trieEdgeMask;
+		}
+		if (!create)
+			return -1;
+		edge_p->parent = node;
+		edge_p->hash = hash;
+		edge_p->level_p = level_p;
+		edge_p->len = len;
+		child_p = &edge_p->child;
+	}
+
+	if (*child_p == -1) {
+		*child_p = cfg_p->trieNodeCnt++;
+		cfg_p->trieNode[*child_p].plusChild = -1;
+		cfg_p->trieNode[*child_p].hashChild = -1;
+		cfg_p->trieNode[*child_p].topicIdx = -1;
+	}
+	return *child_p;
+}
+
+// the topic ended at 'node': its own filter matches and so does "<node>/#"
+static void
+match_last (const CONFIG_t *cfg_p, int node, int *match_p, int *cnt_p)
+{
+	if (cfg_p->trieNode[node].topicIdx >= 0)
+		match_p[(*cnt_p)++] = cfg_p->trieNode[node].topicIdx;
+	node = cfg_p->trieNode[node].hashChild;
+	if ((node >= 0) && (cfg_p->trieNode[node].topicIdx >= 0))
+		match_p[(*cnt_p)++] = cfg_p->trieNode[node].topicIdx;
+}
+
+// collect every filter matching the rest of a topic into match_p[] (a
+// matchBuf, one per thread that matches), a topic can only reach a given
+// node one way so there are no duplicates; wildcards in the first level
+// don't match topics starting with '$'
+static void
+match_topic (const CONFIG_t *cfg_p, int node, const char *level_p, bool first, int *match_p, int *cnt_p)
+{
+	int child;
+	bool sys;
+	size_t len;
+	const char *end_p;
+	const TRIEnode_t *node_p = &cfg_p->trieNode[node];
+
+	sys = first && (level_p[0] == '$');
+	if ((node_p->hashChild >= 0) && !sys && (cfg_p->trieNode[node_p->hashChild].topicIdx >= 0))
+		match_p[(*cnt_p)++] = cfg_p->trieNode[node_p->hashChild].topicIdx;
+
+	end_p = strchr(level_p, '/');
+	len = (end_p != NULL)? (size_t)(end_p - level_p) : strlen(level_p);
+
+	child = trie_child((CONFIG_t*)cfg_p, node, level_p, len, false);
+	if (child >= 0) {
+		if (end_p != NULL)
+			match_topic(cfg_p, child, end_p + 1, false, match_p, cnt_p);
+		else
+			match_last(cfg_p, child, match_p, cnt_p);
+	}
+
+	child = node_p->plusChild;
+	if ((child >= 0) && !sys) {
+		if (end_p != NULL)
+			match_topic(cfg_p, child, end_p + 1, false, match_p, cnt_p);
+		else
+			match_last(cfg_p, child, match_p, cnt_p);
+	}
+}
+
+// stage a GPIO value, flush_gpios() writes it out; a pin that's already
+// at that value, or has it staged, isn't touched again, so dashboards
+// republishing the same state every few seconds cost nothing (a line
+// whose last write failed is retried)
+static void
+set_gpio (MQTTGPIO_t *ctx_p, int gpio, int val)
+{
+	GPIOinfo_t *gpio_p = &ctx_p->cfg->gpioInfo[gpio];
+	BULKinfo_t *bulk_p = &ctx_p->bulkInfo[gpio_p->bulkIdx];
+
+	if ((bulk_p->values[gpio_p->bulkPos] == val) && (bulk_p->dirty || (bulk_p->written[gpio_p->bulkPos] == val))) {
+		atomic_fetch_add_explicit(&chip_shard(ctx_p, gpio_p->chipIdx)->pinSkipCnt, 1, memory_order_relaxed);
+		return;
+	}
+	note_state(ctx_p, gpio);
+	bulk_p->values[gpio_p->bulkPos] = val;
+	mark_dirty(ctx_p, gpio_p->bulkIdx);
+}
+
+// a STATE echo compares against the value from before the batch
+static void
+note_state (MQTTGPIO_t *ctx_p, int gpio)
+{
+	GPIOinfo_t *gpio_p = &ctx_p->cfg->gpioInfo[gpio];
+	SHARD_t *shard_p;
+
+	if ((gpio_p->stateTopic != NULL) && !gpio_p->statePending) {
+		gpio_p->statePending = true;
+		gpio_p->stateWas = ctx_p->bulkInfo[gpio_p->bulkIdx].values[gpio_p->bulkPos];
+		shard_p = chip_shard(ctx_p, gpio_p->chipIdx);
+		shard_p->stateDirty[shard_p->stateDirtyCnt++] = gpio;
+	}
+}
+
+static void
+mark_dirty (MQTTGPIO_t *ctx_p, int bulk)
+{
+	SHARD_t *shard_p;
+
+	if (!ctx_p->bulkInfo[bulk].dirty) {
+		ctx_p->bulkInfo[bulk].dirty = true;
+		shard_p = chip_shard(ctx_p, ctx_p->bulkInfo[bulk].chipIdx);
+		shard_p->dirtyBulk[shard_p->dirtyBulkCnt++] = bulk;
+	}
+}
+
+// a scene's pattern is copied into the staged values of each bulk request
+// it covers, in bulk order, so flush_gpios() writes every chip once; each
+// shard applies the part on its own chips
+static void
+apply_scene (MQTTGPIO_t *ctx_p, SHARD_t *shard_p, const SCENEinfo_t *scene_p)
+{
+	int i, val;
+	bool changed;
+	unsigned pos;
+	uint64_t mask;
+	BULKinfo_t *bulk_p;
+	GPIOinfo_t *gpio_p;
+
+	// a scene is a new command for each of its GPIOs
+	for (i=0; i<scene_p->gpioIdxCnt; ++i) {
+		gpio_p = &ctx_p->cfg->gpioInfo[scene_p->gpioIdx[i]];
+		if (chip_shard(ctx_p, gpio_p->chipIdx) != shard_p)
+			continue;
+		wheel_del(&shard_p->wheel, &gpio_p->revert);
+		note_state(ctx_p, scene_p->gpioIdx[i]);
+	}
+	for (i=0; i<scene_p->bulkCnt; ++i) {
+		bulk_p = &ctx_p->bulkInfo[scene_p->bulk[i].bulkIdx];
+		if (chip_shard(ctx_p, bulk_p->chipIdx) != shard_p)
+			continue;
+		changed = false;
+		for (mask = scene_p->bulk[i].mask; mask != 0; mask &= mask - 1) {
+			pos = (unsigned)__builtin_ctzll(mask);
+			val = (int)((scene_p->bulk[i].bits >> pos) & 1);
+			if ((bulk_p->values[pos] == val) && (bulk_p->dirty || (bulk_p->written[pos] == val))) {
+				atomic_fetch_add_explicit(&shard_p->pinSkipCnt, 1, memory_order_relaxed);
+				continue;
+			}
+			bulk_p->values[pos] = val;
+			changed = true;
+		}
+		if (changed)
+			mark_dirty(ctx_p, scene_p->bulk[i].bulkIdx);
+	}
+}
+
+// the value last staged (or written) for a GPIO
+static int
+get_gpio (MQTTGPIO_t *ctx_p, int gpio)
+{
+	return ctx_p->bulkInfo[ctx_p->cfg->gpioInfo[gpio].bulkIdx].values[ctx_p->cfg->gpioInfo[gpio].bulkPos];
+}
+
+SHARD_t *
+chip_shard (MQTTGPIO_t *ctx_p, int chipIdx)
+{
+	return &ctx_p->shard[ctx_p->chipInfo[chipIdx].shard];
+}
+
+// one set-values ioctl per chip of the shard touched since its last
+// flush, unless the batch put every one of its lines back the way it was
+static void
+flush_gpios (MQTTGPIO_t *ctx_p, SHARD_t *shard_p)
+{
+	int i, ret;
+	uint64_t startNs;
+	BULKinfo_t *bulk_p;
+	GPIOinfo_t *gpio_p;
+
+	for (i=0; i<shard_p->dirtyBulkCnt; ++i) {
+		bulk_p = &ctx_p->bulkInfo[shard_p->dirtyBulk[i]];
+		if (memcmp(bulk_p->values, bulk_p->written, bulk_p->lineCnt * sizeof(int)) == 0) {
+			atomic_fetch_add_explicit(&shard_p->writeSkipCnt, 1, memory_order_relaxed);
+			bulk_p->dirty = false;
+			continue;
+		}
+		startNs = now_ns();
+		ret = gpio_out_set(bulk_p->req, bulk_p->values);
+		hist_add(&ctx_p->stageHist[STAT_WRITE], now_ns() - startNs);
+		if (ret != 0)
+			log_err("can't set values on chip %s\n", ctx_p->chipInfo[bulk_p->chipIdx].name);
+		else {
+			memcpy(bulk_p->written, bulk_p->values, sizeof(bulk_p->written));
+			bulk_p->dirty = false;
+			atomic_fetch_add_explicit(&ctx_p->chipInfo[bulk_p->chipIdx].writeCnt, 1, memory_order_relaxed);
+		}
+	}
+
+	// echo what was actually written if it differs from before the batch,
+	// a failed bulk keeps its dirty flag until here so its lines are skipped
+	for (i=0; i<shard_p->stateDirtyCnt; ++i) {
+		gpio_p = &ctx_p->cfg->gpioInfo[shard_p->stateDirty[i]];
+		gpio_p->statePending = false;
+		bulk_p = &ctx_p->bulkInfo[gpio_p->bulkIdx];
+		if (!bulk_p->dirty && (bulk_p->values[gpio_p->bulkPos] != gpio_p->stateWas))
+			publish_state(ctx_p, shard_p->stateDirty[i]);
+	}
+	shard_p->stateDirtyCnt = 0;
+
+	for (i=0; i<shard_p->dirtyBulkCnt; ++i)
+		ctx_p->bulkInfo[shard_p->dirtyBulk[i]].dirty = false;
+	shard_p->dirtyBulkCnt = 0;
+}
+
+// retained, so a dashboard gets the current value as soon as it subscribes
+void
+publish_state (MQTTGPIO_t *ctx_p, int gpio)
+{
+	int ret;
+	const char *payload_p;
+	GPIOinfo_t *gpio_p = &ctx_p->cfg->gpioInfo[gpio];
+	BROKERinfo_t *broker_p;
+
+	if ((gpio_p->stateTopic == NULL) || (gpio_p->brokerIdx < 0))
+		return;
+	broker_p = &ctx_p->cfg->brokerInfo[gpio_p->brokerIdx];
+	if (!broker_p->connected)
+		return;
+
+	payload_p = ctx_p->bulkInfo[gpio_p->bulkIdx].values[gpio_p->bulkPos]? "ON" : "OFF";
+	log_info("publishing %s to '%s' (retained)\n", payload_p, gpio_p->stateTopic);
+	ret = mosquitto_publish(broker_p->mosq, NULL, gpio_p->stateTopic, strlen(payload_p), payload_p, 1, true);
+	if (ret != MOSQ_ERR_SUCCESS)
+		log_err("can't publish to '%s': %s\n", gpio_p->stateTopic, mosquitto_strerror(ret));
+	broker_wake(broker_p);
+}
+
+// the retained values may be stale if we were away: a shard republishes
+// those of its own pins, NULL all of them
+static void
+publish_states (MQTTGPIO_t *ctx_p, SHARD_t *shard_p, int brokerIdx)
+{
+	int i;
+
+	for (i=0; i<ctx_p->cfg->gpioInfoCnt; ++i)
+		if ((ctx_p->cfg->gpioInfo[i].brokerIdx == brokerIdx)
+				&& ((shard_p == NULL) || (chip_shard(ctx_p, ctx_p->cfg->gpioInfo[i].chipIdx) == shard_p)))
+			publish_state(ctx_p, i);
+}
+
+// runs on the broker's thread: decode, queue, and get back to the socket
+void
+process_message (NOTU struct mosquitto *mosq, void *userdata, const struct mosquitto_message *msg)
+{
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)userdata;
+
+	queue_message(broker_p, msg->topic, (const char*)msg->payload, (msg->payload != NULL)? (size_t)msg->payloadlen : 0);
+}
+
+static bool
+queue_message (BROKERinfo_t *broker_p, const char *topic_p, const char *payload_p, size_t payloadLen)
+{
+	int val;
+	uint32_t durMs = 0;
+	uint64_t recvNs = now_ns();
+	unsigned long dropped;
+	MQTTGPIO_t *ctx_p = broker_p->ctx_p;
+	const char *raw_p = payload_p;
+	size_t rawLen = payloadLen;
+
+	atomic_fetch_add_explicit(&broker_p->msgCnt, 1, memory_order_relaxed);
+
+	// check payload
+	val = parse_payload(payload_p, payloadLen, &durMs);
+
+	// it goes along (without surrounding blanks, if it isn't too long) for
+	// the SCENEs and PERSISTENT CMDs, the main thread has the last word on
+	// whether it's unhandled
+	while ((payloadLen > 0) && ((*payload_p == ' ') || (*payload_p == '\t') || (*payload_p == '\r') || (*payload_p == '\n'))) {
+		++payload_p;
+		--payloadLen;
+	}
+	while ((payloadLen > 0) && ((payload_p[payloadLen-1] == ' ') || (payload_p[payloadLen-1] == '\t')
+			|| (payload_p[payloadLen-1] == '\r') || (payload_p[payloadLen-1] == '\n')))
+		--payloadLen;
+	if (payloadLen > RING_PAYLOAD_MAX)
+		payloadLen = 0;
+	if ((val == -1) && (payloadLen == 0)) {
+		atomic_fetch_add_explicit(&ctx_p->unhandledCnt, 1, memory_order_relaxed);
+		log_warning("unhandled payload: '%.*s'%s on '%s'\n", (rawLen > 32)? 32 : (int)rawLen,
+				(raw_p != NULL)? raw_p : "", (rawLen > 32)? "..." : "", topic_p);
+		return false;
+	}
+
+	if (!ring_push(&broker_p->ring, ACTION_MSG, val, durMs, recvNs, topic_p, strlen(topic_p), payload_p, payloadLen)) {
+		dropped = atomic_load_explicit(&broker_p->ring.dropped, memory_order_relaxed);
+		if ((dropped & (dropped - 1)) == 0)
+			log_warning("broker '%s': action queue full, %lu message(s) dropped\n", broker_p->brokerName, dropped);
+		return false;
+	}
+
+	// ring_notify() wakes the main thread once per pass, a burst read in
+	// one go shouldn't have to wait that long
+	if (broker_p->pushed && (ring_fill(&broker_p->ring) > (broker_p->ring.mask + 1) / 2))
+		action_wake(ctx_p);
+	broker_p->pushed = true;
+	hist_add(&ctx_p->stageHist[STAT_DECODE], now_ns() - recvNs);
+	return true;
+}
+
+// at the end of a broker thread's pass, one wakeup for what it queued
+void
+ring_notify (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p)
+{
+	if (!broker_p->pushed)
+		return;
+	broker_p->pushed = false;
+	action_wake(ctx_p);
+}
+
+bool
+mqttgpio_inject (MQTTGPIO_t *ctx_p, int brokerIdx, const char *topic_p, const void *payload_p, size_t payloadLen)
+{
+	return queue_message(&ctx_p->cfg->brokerInfo[brokerIdx], topic_p, (const char*)payload_p, payloadLen);
+}
+
+void
+mqttgpio_inject_flush (MQTTGPIO_t *ctx_p, int brokerIdx)
+{
+	ring_notify(ctx_p, &ctx_p->cfg->brokerInfo[brokerIdx]);
+}
+
+size_t
+mqttgpio_inject_pending (MQTTGPIO_t *ctx_p, int brokerIdx)
+{
+	return ring_fill(&ctx_p->cfg->brokerInfo[brokerIdx].ring);
+}
+
+// from a broker thread, the shards read the same rings
+void
+action_wake (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	uint64_t one = 1;
+
+	if (write(ctx_p->actionWatch_p->fd, &one, sizeof(one)) != sizeof(one))
+		perror("write(action)");
+	for (i=0; ctx_p->sharded && (i<ctx_p->shardCnt); ++i)
+		if (write(ctx_p->shard[i].wakeWatch_p->fd, &one, sizeof(one)) != sizeof(one))
+			perror("write(shard)");
+}
+
+// payloads aren't NUL-terminated and are looked at in place: ON/OFF, 1/0,
+// true/false or TOGGLE (any case, surrounding blanks ignored), ON/OFF
+// <seconds> or PULSE <ms>, or a JSON object whose "state" member is one
+// of those; returns 1, 0, VAL_TOGGLE, or -1 for anything else, a timed
+// form also sets *durMs_p
+static int
+parse_payload (const char *p, size_t len, uint32_t *durMs_p)
+{
+	const char *end_p = p + len;
+	const char *arg_p;
+
+	while ((p < end_p) && ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')))
+		++p;
+	while ((end_p > p) && ((end_p[-1] == ' ') || (end_p[-1] == '\t') || (end_p[-1] == '\r') || (end_p[-1] == '\n')))
+		--end_p;
+	if (p == end_p)
+		return -1;
+
+	// "<word> <number>"
+	for (arg_p = p; (arg_p < end_p) && (*arg_p != ' ') && (*arg_p != '\t'); ++arg_p)
+		;
+	if ((arg_p < end_p) && (*p != '{')) {
+		switch (arg_p - p) {
+			case 2:
+				if ((strncasecmp(p, "ON", 2) == 0) && parse_duration(arg_p, end_p, 1000, durMs_p))
+					return 1;
+				break;
+			case 3:
+				if ((strncasecmp(p, "OFF", 3) == 0) && parse_duration(arg_p, end_p, 1000, durMs_p))
+					return 0;
+				break;
+			case 5:
+				if ((strncasecmp(p, "PULSE", 5) == 0) && parse_duration(arg_p, end_p, 1, durMs_p))
+					return 1;
+				break;
+			default:
+				break;
+		}
+		return -1;
+	}
+
+	switch (end_p - p) {
+		case 1:
+			if (*p == '1')
+				return 1;
+			if (*p == '0')
+				return 0;
+			break;
+		case 2:
+			if (strncasecmp(p, "ON", 2) == 0)
+				return 1;
+			break;
+		case 3:
+			if (strncasecmp(p, "OFF", 3) == 0)
+				return 0;
+			break;
+		case 4:
+			if (strncasecmp(p, "TRUE", 4) == 0)
+				return 1;
+			break;
+		case 5:
+			if (strncasecmp(p, "FALSE", 5) == 0)
+				return 0;
+			break;
+		case 6:
+			if (strncasecmp(p, "TOGGLE", 6) == 0)
+				return VAL_TOGGLE;
+			break;
+		default:
+			break;
+	}
+
+	if ((*p == '{') && (end_p[-1] == '}'))
+		return parse_json_state(p + 1, end_p - 1, durMs_p);
+	return -1;
+}
+
+// a positive decimal number of 'scale' ms, at most ~49 days
+static bool
+parse_duration (const char *p, const char *end_p, uint32_t scale, uint32_t *durMs_p)
+{
+	uint64_t val = 0;
+
+	while ((p < end_p) && ((*p == ' ') || (*p == '\t')))
+		++p;
+	if (p == end_p)
+		return false;
+	for (; p < end_p; ++p) {
+		if ((*p < '0') || (*p > '9'))
+			return false;
+		val = val * 10 + (uint64_t)(*p - '0');
+		if (val * scale > UINT32_MAX)
+			return false;
+	}
+	if (val == 0)
+		return false;
+	*durMs_p = (uint32_t)(val * scale);
+	return true;
+}
+
+// just enough JSON to find a top-level "state": <value>, where the value
+// is a string, a bare word (true/false) or a number
+static int
+parse_json_state (const char *p, const char *end_p, uint32_t *durMs_p)
+{
+	int depth = 0;
+	const char *val_p;
+
+	while (p < end_p) {
+		if ((*p == '{') || (*p == '[')) {
+			++depth;
+			++p;
+			continue;
+		}
+		if ((*p == '}') || (*p == ']')) {
+			--depth;
+			++p;
+			continue;
+		}
+		if (*p != '"') {
+			++p;
+			continue;
+		}
+
+		// a string: is it the key?
+		val_p = ++p;
+		while ((p < end_p) && (*p != '"'))
+			p += (*p == '\\')? 2 : 1;
+		if (p >= end_p)
+			return -1;
+		if ((depth != 0) || (p - val_p != 5) || (memcmp(val_p, "state", 5) != 0)) {
+			++p;
+			continue;
+		}
+		++p;
+		while ((p < end_p) && ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')))
+			++p;
+		if ((p >= end_p) || (*p != ':'))
+			continue;
+		++p;
+		while ((p < end_p) && ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')))
+			++p;
+
+		if ((p < end_p) && (*p == '"')) {
+			val_p = ++p;
+			while ((p < end_p) && (*p != '"'))
+				++p;
+		}
+		else {
+			val_p = p;
+			while ((p < end_p) && (*p != ',') && (*p != '}'))
+				++p;
+		}
+		return parse_payload(val_p, p - val_p, durMs_p);
+	}
+	return -1;
+}
+
+bool
+ring_push (RING_t *ring_p, uint8_t type, int8_t val, uint32_t durMs, uint64_t recvNs, const char *topic_p, size_t topicLen,
+		const char *payload_p, size_t payloadLen)
+{
+	size_t head, off, room, len, need;
+	ACTIONrec_t *rec_p;
+
+	len = (sizeof(ACTIONrec_t) + topicLen + 1 + payloadLen + 1 + 7) & ~(size_t)7;
+	if ((len > (ring_p->mask + 1) / 4) || (topicLen > UINT16_MAX) || (payloadLen > UINT16_MAX)) {
+		atomic_fetch_add_explicit(&ring_p->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+
+	head = atomic_load_explicit(&ring_p->head, memory_order_relaxed);
+	off = head & ring_p->mask;
+	room = ring_p->mask + 1 - off;
+	need = (room < len)? room + len : len;
+	if ((ring_p->mask + 1) - ring_fill(ring_p) < need) {
+		atomic_fetch_add_explicit(&ring_p->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+
+	// records don't wrap, pad to the end of the ring instead
+	if (room < len) {
+		((ACTIONrec_t*)(ring_p->buf + off))->len = 0;
+		head += room;
+		off = 0;
+	}
+	rec_p = (ACTIONrec_t*)(ring_p->buf + off);
+	rec_p->len = len;
+	rec_p->type = type;
+	rec_p->val = val;
+	rec_p->durMs = durMs;
+	rec_p->recvNs = recvNs;
+	rec_p->topicLen = topicLen;
+	rec_p->payloadLen = payloadLen;
+	memcpy(rec_p->topic, topic_p, topicLen);
+	rec_p->topic[topicLen] = 0;
+	if (payloadLen > 0)
+		memcpy(rec_p->topic + topicLen + 1, payload_p, payloadLen);
+	rec_p->topic[topicLen + 1 + payloadLen] = 0;
+
+	atomic_store_explicit(&ring_p->head, head + len, memory_order_release);
+	return true;
+}
+
+// bytes in use, up to the reader furthest behind
+static size_t
+ring_fill (RING_t *ring_p)
+{
+	int i;
+	size_t head, used, n;
+
+	head = atomic_load_explicit(&ring_p->head, memory_order_relaxed);
+	used = head - atomic_load_explicit(&ring_p->tail, memory_order_acquire);
+	for (i=0; i<ring_p->shardCnt; ++i) {
+		n = head - atomic_load_explicit(&ring_p->shardTail[i], memory_order_acquire);
+		if (n > used)
+			used = n;
+	}
+	return used;
+}
+
+// visit the records up to 'end' without consuming them, for a shard's
+// pins or (shard_p NULL) the CMDs and connects; atNs is when the batch was
+// picked up, the queue stage ends with whichever pass comes first (the
+// shard without SHARDS, the main thread's with them)
+static void
+ring_walk (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p, SHARD_t *shard_p, size_t end, uint64_t atNs)
+{
+	int matchCnt;
+	bool pins;
+	size_t pos, off;
+	ACTIONrec_t *rec_p;
+	RING_t *ring_p = &broker_p->ring;
+
+	pos = ((shard_p != NULL) && ctx_p->sharded)? atomic_load_explicit(&ring_p->shardTail[shard_p->shardIdx], memory_order_relaxed)
+		: atomic_load_explicit(&ring_p->tail, memory_order_relaxed);
+	while (pos != end) {
+		off = pos & ring_p->mask;
+		rec_p = (ACTIONrec_t*)(ring_p->buf + off);
+		if (rec_p->len == 0) {
+			pos += ring_p->mask + 1 - off;
+			continue;
+		}
+		if (rec_p->type == ACTION_MSG) {
+			matchCnt = apply_message(ctx_p, broker_p->brokerIdx, shard_p, rec_p->topic, rec_p->val, rec_p->durMs,
+					rec_p->topic + rec_p->topicLen + 1, rec_p->payloadLen, &pins);
+			if ((shard_p != NULL) != ctx_p->sharded)
+				hist_add(&ctx_p->stageHist[STAT_QUEUE], atNs - rec_p->recvNs);
+			if (shard_p == NULL)
+				stats_message(ctx_p, rec_p->recvNs, matchCnt);
+			else if (pins)
+				shard_p->pinRecvNs[shard_p->pinRecvCnt++] = rec_p->recvNs;
+		}
+		else if (shard_p == NULL)
+			apply_connect(ctx_p, broker_p, rec_p->val);
+		else if (ctx_p->sharded)
+			publish_states(ctx_p, shard_p, broker_p->brokerIdx);
+		pos += rec_p->len;
+	}
+}
+
+// everything queued on every broker is taken at once; without SHARDS the
+// main thread is the actuation thread: all the pin writes first (one
+// ioctl per chip, a pin switched several times only gets its last
+// value), then the CMDs and connects in arrival order; with SHARDS the
+// shard threads do the pins on their own and this is only the second half
+void
+action_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, NOTU void *data_p)
+{
+	int i;
+	uint64_t cnt, atNs;
+	BROKERinfo_t *broker_p;
+
+	while (read(ctx_p->actionWatch_p->fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+		;
+
+	atNs = now_ns();
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		broker_p->batchEnd = atomic_load_explicit(&broker_p->ring.head, memory_order_acquire);
+		if (!ctx_p->sharded)
+			ring_walk(ctx_p, broker_p, &ctx_p->shard[0], broker_p->batchEnd, atNs);
+	}
+
+	if (!ctx_p->sharded)
+		shard_flush(ctx_p, &ctx_p->shard[0]);
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		ring_walk(ctx_p, broker_p, NULL, broker_p->batchEnd, atNs);
+		atomic_store_explicit(&broker_p->ring.tail, broker_p->batchEnd, memory_order_release);
+	}
+}
+
+// one pass of one message: stage the pins and scenes of a shard, or
+// start/stop its CMDs (a duration only applies to pins, for a CMD ON <s>
+// is just ON) and hand it to its PERSISTENT ones, whatever the payload
+// (shard_p NULL); returns how many topics matched, they're left in the
+// shard's matchBuf or cfg->matchBuf, *pins_p says whether it reached any
+// of the shard's pins
+static int
+apply_message (MQTTGPIO_t *ctx_p, int brokerIdx, SHARD_t *shard_p, const char *topic_p, int val, uint32_t durMs,
+		const char *payload_p, size_t payloadLen, bool *pins_p)
+{
+	int m, matchCnt, topic, i, j, gpio, cmd, subVal, takenCnt;
+	int *match_p;
+	SUBinfo_t *sub_p;
+	const SCENEinfo_t *scene_p;
+
+	*pins_p = false;
+	if (ctx_p->cfg->trieNode == NULL)
+		return 0;
+	match_p = (shard_p != NULL)? shard_p->matchBuf : ctx_p->cfg->matchBuf;
+	matchCnt = takenCnt = 0;
+	match_topic(ctx_p->cfg, brokerIdx, topic_p, true, match_p, &matchCnt);
+
+	for (m=0; m<matchCnt; ++m) {
+		topic = match_p[m];
+
+		for (i=0; i<ctx_p->cfg->topicInfo[topic].subIdxCnt; ++i) {
+			sub_p = &ctx_p->cfg->subInfo[ctx_p->cfg->topicInfo[topic].subIdx[i]];
+			subVal = (val == VAL_TOGGLE)? VAL_TOGGLE : (sub_p->inv? !val : val);
+			takenCnt += sub_p->helperCnt;
+
+			if (shard_p != NULL) {
+				for (j=0; (val >= 0) && (j<sub_p->gpioIdxCnt); ++j) {
+					gpio = sub_p->gpioIdx[j];
+					if (chip_shard(ctx_p, ctx_p->cfg->gpioInfo[gpio].chipIdx) != shard_p)
+						continue;
+					*pins_p = true;
+
+					// from whatever this batch has staged so far
+					if (val == VAL_TOGGLE)
+						subVal = !get_gpio(ctx_p, gpio);
+
+					// a new command replaces any pending revert
+					if (durMs != 0) {
+						ctx_p->cfg->gpioInfo[gpio].revertVal = !subVal;
+						wheel_add(&shard_p->wheel, &ctx_p->cfg->gpioInfo[gpio].revert, durMs);
+					}
+					else
+						wheel_del(&shard_p->wheel, &ctx_p->cfg->gpioInfo[gpio].revert);
+					log_info("setting gpio chip %s pin %d to %d%s\n",
+							ctx_p->cfg->gpioInfo[gpio].chipStr,
+							ctx_p->cfg->gpioInfo[gpio].pin, subVal,
+							sub_p->inv? " INV" : "");
+					set_gpio(ctx_p, gpio, subVal);
+				}
+				continue;
+			}
+
+			for (j=0; j<sub_p->cmdIdxCnt; ++j) {
+				cmd = sub_p->cmdIdx[j];
+
+				if (ctx_p->cfg->cmdInfo[cmd].persistent) {
+					helper_send(ctx_p, cmd, topic_p, payload_p, payloadLen);
+					continue;
+				}
+				if (val < 0)
+					continue;
+
+				// TOGGLE stops a child that's running (and not already
+				// stopping), otherwise starts one
+				if (subVal == VAL_TOGGLE) {
+					if (cmd_running(&ctx_p->cfg->cmdInfo[cmd]))
+						stop_cmd(ctx_p, cmd);
+					else
+						start_cmd(ctx_p, cmd);
+				}
+
+				// process "ON" message
+				else if (subVal == 1)
+					start_cmd(ctx_p, cmd);
+
+				// process "OFF" message
+				else
+					stop_cmd(ctx_p, cmd);
+			}
+		}
+
+		// after the SUBs, a scene has the last word on its pins
+		for (i=0; i<ctx_p->cfg->topicInfo[topic].sceneIdxCnt; ++i) {
+			scene_p = &ctx_p->cfg->sceneInfo[ctx_p->cfg->topicInfo[topic].sceneIdx[i]];
+			if ((strlen(scene_p->payload) != payloadLen) || (strncasecmp(scene_p->payload, payload_p, payloadLen) != 0))
+				continue;
+			if (shard_p != NULL) {
+				apply_scene(ctx_p, shard_p, scene_p);
+				*pins_p = true;
+			}
+			else
+				log_info("scene '%s' on '%s': %d GPIO(s), %d bulk write(s)\n", scene_p->payload, scene_p->topicStr,
+						scene_p->gpioIdxCnt, scene_p->bulkCnt);
+			++takenCnt;
+		}
+	}
+
+	if ((shard_p == NULL) && (val < 0) && (takenCnt == 0)) {
+		atomic_fetch_add_explicit(&ctx_p->unhandledCnt, 1, memory_order_relaxed);
+		log_warning("unhandled payload: '%.*s'%s on '%s'\n", (payloadLen > 32)? 32 : (int)payloadLen, payload_p,
+				(payloadLen > 32)? "..." : "", topic_p);
+	}
+	return matchCnt;
+}
+
+static void
+apply_connect (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p, bool sessionPresent)
+{
+	// a persistent session still has our subscriptions, unless the
+	// config was reloaded while we were away
+	if (!sessionPresent || broker_p->resubscribe)
+		subscribe_all(ctx_p, broker_p);
+
+	// with SHARDS each shard republishes its own
+	if (!ctx_p->sharded)
+		publish_states(ctx_p, NULL, broker_p->brokerIdx);
+}
@@ -0,0 +1,562 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// --compile-config's output: a CONFIG_t written as fixed-size records and
+// one string table, read back (when it's as new as the text) instead of
+// parsing
+
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include "libmqttgpio-int.h"
+
+#define IMAGE_MAGIC 0x4347514d
+#define IMAGE_VERSION 7
+#define FNV64_OFFSET 14695981039346656037u
+
+// what --compile-config writes: this header, the record tables in this
+// order, then one string table; strings are offsets into it (0 is NULL),
+// each one is stored once so the interning survives the round trip
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t textHash;	// of the config file it was compiled from
+	uint64_t imageHash;	// of everything after the header
+	uint32_t cmdGraceMs;
+	uint32_t cmdMax;
+	uint32_t statsSec;
+	uint32_t statsTopic;
+	uint32_t statsBrokerName;
+	uint32_t brokerCnt;
+	uint32_t gpioCnt;
+	uint32_t cmdCnt;
+	uint32_t inputCnt;
+	uint32_t pubCnt;
+	uint32_t subCnt;
+	uint32_t sceneCnt;
+	uint32_t sceneSetCnt;
+	uint32_t strSize;
+	uint32_t metricsAddr;
+	int32_t rtPrio;
+	int32_t rtCpu;
+	uint32_t shardCnt;
+} IMGheader_t;
+
+typedef struct {
+	uint32_t name;
+	uint32_t server;
+	uint32_t clientId;
+	int32_t port;
+} IMGbroker_t;
+
+typedef struct {
+	uint32_t name;
+	uint32_t chip;
+	uint32_t stateTopic;
+	uint32_t brokerName;
+	int32_t pin;
+} IMGgpio_t;
+
+typedef struct {
+	uint32_t name;
+	uint32_t cmdStr;
+	uint32_t replyTopic;
+	uint32_t brokerName;
+	int32_t persistent;
+	int32_t maxChildren;
+	int32_t queueMax;
+	int32_t restart;
+} IMGcmd_t;
+
+typedef struct {
+	uint32_t name;
+	uint32_t chip;
+	int32_t pin;
+	int32_t debounceMs;
+} IMGinput_t;
+
+typedef struct {
+	uint32_t topic;
+	uint32_t input;
+	uint32_t brokerName;
+	int32_t qos;
+	int32_t inv;
+	int32_t coalesceMs;
+	int32_t rateMax;
+	int32_t count;
+} IMGpub_t;
+
+typedef struct {
+	uint32_t topic;
+	uint32_t name;
+	uint32_t brokerName;
+	int32_t qos;
+	int32_t inv;
+} IMGsub_t;
+
+// a scene's sets follow those of the scene before it
+typedef struct {
+	uint32_t topic;
+	uint32_t payload;
+	uint32_t brokerName;
+	int32_t qos;
+	int32_t setCnt;
+} IMGscene_t;
+
+typedef struct {
+	uint32_t gpioName;
+	int32_t val;
+} IMGsceneSet_t;
+
+static uint64_t hash_bytes (uint64_t hash, const void *data_p, size_t len);
+static uint32_t image_str (const ARENA_t *arena_p, const uint32_t *offs_p, const char *str_p);
+static const char *image_str_at (const char *strs_p, uint32_t strSize, uint32_t off, bool *ok_p);
+
+bool
+hash_file (const char *fileName_p, uint64_t *hash_p)
+{
+	FILE *stream;
+	size_t len;
+	char buf[65536];
+
+	stream = fopen(fileName_p, "r");
+	if (stream == NULL) {
+		perror("fopen()");
+		log_err("%s\n", fileName_p);
+		return false;
+	}
+	*hash_p = FNV64_OFFSET;
+	while ((len = fread(buf, 1, sizeof(buf), stream)) > 0)
+		*hash_p = hash_bytes(*hash_p, buf, len);
+	fclose(stream);
+	return true;
+}
+
+// FNV-1a, 64 bits
+static uint64_t
+hash_bytes (uint64_t hash, const void *data_p, size_t len)
+{
+	const unsigned char *p = (const unsigned char*)data_p;
+
+	while (len-- > 0) {
+		hash ^= *p++;
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
+
+// an interned string's offset in the image's string table
+static uint32_t
+image_str (const ARENA_t *arena_p, const uint32_t *offs_p, const char *str_p)
+{
+	uint32_t slot;
+
+	if (str_p == NULL)
+		return 0;
+	for (slot = hash_str(str_p) & arena_p->strMask; arena_p->strs[slot] != str_p; slot = (slot + 1) & arena_p->strMask)
+		;
+	return offs_p[slot];
+}
+
+// written next to the final name and renamed over it, a daemon starting
+// meanwhile sees the old image or the new one
+bool
+write_config_image (CONFIG_t *cfg_p, uint64_t textHash, const char *imageFile_p)
+{
+	int i, k, setCnt;
+	bool ok;
+	size_t size, pos;
+	uint32_t slot, strSize, *offs_p;
+	unsigned char *buf_p;
+	char tmpFile[PATH_MAX + 8];
+	FILE *stream;
+	ARENA_t *arena_p = &cfg_p->arena;
+	IMGheader_t *hdr_p;
+	IMGbroker_t *broker_p;
+	IMGgpio_t *gpio_p;
+	IMGcmd_t *cmd_p;
+	IMGinput_t *input_p;
+	IMGpub_t *pub_p;
+	IMGsub_t *sub_p;
+	IMGscene_t *scene_p;
+	IMGsceneSet_t *set_p;
+
+	// the broker table isn't interned (it outlives the arena), this copy is
+	for (i=0; i<cfg_p->brokerInfoCnt; ++i) {
+		arena_intern(arena_p, cfg_p->brokerInfo[i].brokerName);
+		arena_intern(arena_p, cfg_p->brokerInfo[i].server);
+		if (cfg_p->brokerInfo[i].clientId != NULL)
+			arena_intern(arena_p, cfg_p->brokerInfo[i].clientId);
+	}
+
+	offs_p = (uint32_t*)calloc(arena_p->strMask + 1, sizeof(uint32_t));
+	if (offs_p == NULL) {
+		perror("calloc(image strings)");
+		return false;
+	}
+	strSize = 1;
+	for (slot=0; slot<=arena_p->strMask; ++slot) {
+		if (arena_p->strs[slot] == NULL)
+			continue;
+		offs_p[slot] = strSize;
+		strSize += strlen(arena_p->strs[slot]) + 1;
+	}
+
+	setCnt = 0;
+	for (i=0; i<cfg_p->sceneInfoCnt; ++i)
+		setCnt += cfg_p->sceneInfo[i].setCnt;
+	size = sizeof(IMGheader_t) + cfg_p->brokerInfoCnt * sizeof(IMGbroker_t) + cfg_p->gpioInfoCnt * sizeof(IMGgpio_t)
+		+ cfg_p->cmdInfoCnt * sizeof(IMGcmd_t) + cfg_p->inputInfoCnt * sizeof(IMGinput_t)
+		+ cfg_p->pubInfoCnt * sizeof(IMGpub_t) + cfg_p->subInfoCnt * sizeof(IMGsub_t)
+		+ cfg_p->sceneInfoCnt * sizeof(IMGscene_t) + setCnt * sizeof(IMGsceneSet_t) + strSize;
+	buf_p = (unsigned char*)calloc(1, size);
+	if (buf_p == NULL) {
+		perror("calloc(image)");
+		free(offs_p);
+		return false;
+	}
+
+	hdr_p = (IMGheader_t*)buf_p;
+	hdr_p->magic = IMAGE_MAGIC;
+	hdr_p->version = IMAGE_VERSION;
+	hdr_p->textHash = textHash;
+	hdr_p->cmdGraceMs = cfg_p->cmdGraceMs;
+	hdr_p->cmdMax = cfg_p->cmdMax;
+	hdr_p->statsSec = cfg_p->statsSec;
+	hdr_p->statsTopic = image_str(arena_p, offs_p, cfg_p->statsTopic);
+	hdr_p->metricsAddr = image_str(arena_p, offs_p, cfg_p->metricsAddr);
+	hdr_p->rtPrio = cfg_p->rtPrio;
+	hdr_p->rtCpu = cfg_p->rtCpu;
+	hdr_p->shardCnt = cfg_p->shardCnt;
+	hdr_p->statsBrokerName = image_str(arena_p, offs_p, cfg_p->statsBrokerName);
+	hdr_p->brokerCnt = cfg_p->brokerInfoCnt;
+	hdr_p->gpioCnt = cfg_p->gpioInfoCnt;
+	hdr_p->cmdCnt = cfg_p->cmdInfoCnt;
+	hdr_p->inputCnt = cfg_p->inputInfoCnt;
+	hdr_p->pubCnt = cfg_p->pubInfoCnt;
+	hdr_p->subCnt = cfg_p->subInfoCnt;
+	hdr_p->sceneCnt = cfg_p->sceneInfoCnt;
+	hdr_p->sceneSetCnt = setCnt;
+	hdr_p->strSize = strSize;
+	pos = sizeof(IMGheader_t);
+
+	for (i=0; i<cfg_p->brokerInfoCnt; ++i, pos+=sizeof(IMGbroker_t)) {
+		broker_p = (IMGbroker_t*)(buf_p + pos);
+		broker_p->name = image_str(arena_p, offs_p, arena_intern(arena_p, cfg_p->brokerInfo[i].brokerName));
+		broker_p->server = image_str(arena_p, offs_p, arena_intern(arena_p, cfg_p->brokerInfo[i].server));
+		broker_p->clientId = (cfg_p->brokerInfo[i].clientId == NULL)? 0
+			: image_str(arena_p, offs_p, arena_intern(arena_p, cfg_p->brokerInfo[i].clientId));
+		broker_p->port = cfg_p->brokerInfo[i].port;
+	}
+	for (i=0; i<cfg_p->gpioInfoCnt; ++i, pos+=sizeof(IMGgpio_t)) {
+		gpio_p = (IMGgpio_t*)(buf_p + pos);
+		gpio_p->name = image_str(arena_p, offs_p, cfg_p->gpioInfo[i].gpioName);
+		gpio_p->chip = image_str(arena_p, offs_p, cfg_p->gpioInfo[i].chipStr);
+		gpio_p->stateTopic = image_str(arena_p, offs_p, cfg_p->gpioInfo[i].stateTopic);
+		gpio_p->brokerName = image_str(arena_p, offs_p, cfg_p->gpioInfo[i].brokerName);
+		gpio_p->pin = cfg_p->gpioInfo[i].pin;
+	}
+	for (i=0; i<cfg_p->cmdInfoCnt; ++i, pos+=sizeof(IMGcmd_t)) {
+		cmd_p = (IMGcmd_t*)(buf_p + pos);
+		cmd_p->name = image_str(arena_p, offs_p, cfg_p->cmdInfo[i].actionName);
+		cmd_p->cmdStr = image_str(arena_p, offs_p, cfg_p->cmdInfo[i].cmdStr);
+		cmd_p->replyTopic = image_str(arena_p, offs_p, cfg_p->cmdInfo[i].replyTopic);
+		cmd_p->brokerName = image_str(arena_p, offs_p, cfg_p->cmdInfo[i].brokerName);
+		cmd_p->persistent = cfg_p->cmdInfo[i].persistent;
+		cmd_p->maxChildren = cfg_p->cmdInfo[i].maxChildren;
+		cmd_p->queueMax = cfg_p->cmdInfo[i].queueMax;
+		cmd_p->restart = cfg_p->cmdInfo[i].restart;
+	}
+	for (i=0; i<cfg_p->inputInfoCnt; ++i, pos+=sizeof(IMGinput_t)) {
+		input_p = (IMGinput_t*)(buf_p + pos);
+		input_p->name = image_str(arena_p, offs_p, cfg_p->inputInfo[i].inputName);
+		input_p->chip = image_str(arena_p, offs_p, cfg_p->inputInfo[i].chipStr);
+		input_p->pin = cfg_p->inputInfo[i].pin;
+		input_p->debounceMs = cfg_p->inputInfo[i].debounceMs;
+	}
+	for (i=0; i<cfg_p->pubInfoCnt; ++i, pos+=sizeof(IMGpub_t)) {
+		pub_p = (IMGpub_t*)(buf_p + pos);
+		pub_p->topic = image_str(arena_p, offs_p, cfg_p->pubInfo[i].topicStr);
+		pub_p->input = image_str(arena_p, offs_p, cfg_p->pubInfo[i].inputName);
+		pub_p->brokerName = image_str(arena_p, offs_p, cfg_p->pubInfo[i].brokerName);
+		pub_p->qos = cfg_p->pubInfo[i].qos;
+		pub_p->inv = cfg_p->pubInfo[i].inv;
+		pub_p->coalesceMs = cfg_p->pubInfo[i].coalesceMs;
+		pub_p->rateMax = cfg_p->pubInfo[i].rateMax;
+		pub_p->count = cfg_p->pubInfo[i].count;
+	}
+	for (i=0; i<cfg_p->subInfoCnt; ++i, pos+=sizeof(IMGsub_t)) {
+		sub_p = (IMGsub_t*)(buf_p + pos);
+		sub_p->topic = image_str(arena_p, offs_p, cfg_p->subInfo[i].topicStr);
+		sub_p->name = image_str(arena_p, offs_p, cfg_p->subInfo[i].gpioName);
+		sub_p->brokerName = image_str(arena_p, offs_p, cfg_p->subInfo[i].brokerName);
+		sub_p->qos = cfg_p->subInfo[i].qos;
+		sub_p->inv = cfg_p->subInfo[i].inv;
+	}
+	for (i=0; i<cfg_p->sceneInfoCnt; ++i, pos+=sizeof(IMGscene_t)) {
+		scene_p = (IMGscene_t*)(buf_p + pos);
+		scene_p->topic = image_str(arena_p, offs_p, cfg_p->sceneInfo[i].topicStr);
+		scene_p->payload = image_str(arena_p, offs_p, cfg_p->sceneInfo[i].payload);
+		scene_p->brokerName = image_str(arena_p, offs_p, cfg_p->sceneInfo[i].brokerName);
+		scene_p->qos = cfg_p->sceneInfo[i].qos;
+		scene_p->setCnt = cfg_p->sceneInfo[i].setCnt;
+	}
+	for (i=0; i<cfg_p->sceneInfoCnt; ++i)
+		for (k=0; k<cfg_p->sceneInfo[i].setCnt; ++k, pos+=sizeof(IMGsceneSet_t)) {
+			set_p = (IMGsceneSet_t*)(buf_p + pos);
+			set_p->gpioName = image_str(arena_p, offs_p, cfg_p->sceneInfo[i].set[k].gpioName);
+			set_p->val = cfg_p->sceneInfo[i].set[k].val;
+		}
+	for (slot=0; slot<=arena_p->strMask; ++slot)
+		if (arena_p->strs[slot] != NULL)
+			strcpy((char*)buf_p + pos + offs_p[slot], arena_p->strs[slot]);
+	hdr_p->imageHash = hash_bytes(FNV64_OFFSET, buf_p + sizeof(IMGheader_t), size - sizeof(IMGheader_t));
+	free(offs_p);
+
+	snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", imageFile_p);
+	stream = fopen(tmpFile, "w");
+	if (stream == NULL) {
+		perror("fopen()");
+		log_err("%s\n", tmpFile);
+		free(buf_p);
+		return false;
+	}
+	ok = (fwrite(buf_p, 1, size, stream) == size);
+	ok = (fclose(stream) == 0) && ok;
+	free(buf_p);
+	if (!ok || (rename(tmpFile, imageFile_p) != 0)) {
+		perror("write(image)");
+		log_err("%s\n", imageFile_p);
+		unlink(tmpFile);
+		return false;
+	}
+	return true;
+}
+
+// NULL for offset 0, or if it's past the table (*ok_p cleared)
+static const char *
+image_str_at (const char *strs_p, uint32_t strSize, uint32_t off, bool *ok_p)
+{
+	if (off == 0)
+		return NULL;
+	if (off >= strSize) {
+		*ok_p = false;
+		return NULL;
+	}
+	return strs_p + off;
+}
+
+// no image, or one that's damaged or stale, is a false and the text
+// gets read instead
+bool
+load_config_image (const char *fileName_p, CONFIG_t *cfg_p)
+{
+	int fd, i, k;
+	uint32_t setCnt;
+	bool ok = true;
+	uint64_t textHash, size;
+	char imageFile[PATH_MAX];
+	char *strs_p;
+	const char *name_p, *server_p, *clientId_p;
+	const unsigned char *map_p, *p;
+	const IMGheader_t *hdr_p;
+	const IMGbroker_t *broker_p;
+	const IMGgpio_t *gpio_p;
+	const IMGcmd_t *cmd_p;
+	const IMGinput_t *input_p;
+	const IMGpub_t *pub_p;
+	const IMGsub_t *sub_p;
+	const IMGscene_t *scene_p;
+	const IMGsceneSet_t *set_p;
+	struct stat statInfo;
+
+	if (snprintf(imageFile, sizeof(imageFile), "%s%s", fileName_p, IMAGE_SUFFIX) >= (int)sizeof(imageFile))
+		return false;
+	fd = open(imageFile, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	if ((fstat(fd, &statInfo) != 0) || ((size_t)statInfo.st_size < sizeof(IMGheader_t))) {
+		log_warning("%s: too short, ignored\n", imageFile);
+		close(fd);
+		return false;
+	}
+	map_p = (const unsigned char*)mmap(NULL, statInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map_p == MAP_FAILED) {
+		perror("mmap(image)");
+		return false;
+	}
+
+	hdr_p = (const IMGheader_t*)map_p;
+	size = sizeof(IMGheader_t) + (uint64_t)hdr_p->brokerCnt * sizeof(IMGbroker_t) + (uint64_t)hdr_p->gpioCnt * sizeof(IMGgpio_t)
+		+ (uint64_t)hdr_p->cmdCnt * sizeof(IMGcmd_t) + (uint64_t)hdr_p->inputCnt * sizeof(IMGinput_t)
+		+ (uint64_t)hdr_p->pubCnt * sizeof(IMGpub_t) + (uint64_t)hdr_p->subCnt * sizeof(IMGsub_t)
+		+ (uint64_t)hdr_p->sceneCnt * sizeof(IMGscene_t) + (uint64_t)hdr_p->sceneSetCnt * sizeof(IMGsceneSet_t) + hdr_p->strSize;
+	if ((hdr_p->magic != IMAGE_MAGIC) || (hdr_p->version != IMAGE_VERSION) || (size != (uint64_t)statInfo.st_size)
+			|| (hdr_p->strSize == 0) || (map_p[size - 1] != 0) || (hdr_p->gpioCnt >= INT_MAX) || (hdr_p->subCnt >= INT_MAX)
+			|| (hdr_p->sceneCnt >= INT_MAX) || (hdr_p->sceneSetCnt >= INT_MAX)
+			|| (hash_bytes(FNV64_OFFSET, map_p + sizeof(IMGheader_t), size - sizeof(IMGheader_t)) != hdr_p->imageHash)) {
+		log_warning("%s: not a usable image, ignored\n", imageFile);
+		munmap((void*)map_p, statInfo.st_size);
+		return false;
+	}
+	if (!hash_file(fileName_p, &textHash) || (textHash != hdr_p->textHash)) {
+		log_notice("%s is older than %s, reading that\n", imageFile, fileName_p);
+		munmap((void*)map_p, statInfo.st_size);
+		return false;
+	}
+
+	// the string table is copied in one go, offsets become pointers into it
+	memset(cfg_p, 0, sizeof(CONFIG_t));
+	strs_p = (char*)arena_alloc(&cfg_p->arena, hdr_p->strSize, 1);
+	memcpy(strs_p, map_p + size - hdr_p->strSize, hdr_p->strSize);
+	cfg_p->cmdGraceMs = hdr_p->cmdGraceMs;
+	cfg_p->cmdMax = hdr_p->cmdMax;
+	ok = ok && (cfg_p->cmdMax > 0);
+	cfg_p->statsSec = hdr_p->statsSec;
+	cfg_p->statsTopic = image_str_at(strs_p, hdr_p->strSize, hdr_p->statsTopic, &ok);
+	cfg_p->metricsAddr = image_str_at(strs_p, hdr_p->strSize, hdr_p->metricsAddr, &ok);
+	cfg_p->rtPrio = hdr_p->rtPrio;
+	cfg_p->rtCpu = hdr_p->rtCpu;
+	ok = ok && (cfg_p->rtPrio >= 0) && (cfg_p->rtPrio <= 99) && (cfg_p->rtCpu >= -1);
+	cfg_p->shardCnt = hdr_p->shardCnt;
+	ok = ok && (cfg_p->shardCnt <= SHARD_MAX);
+	cfg_p->statsBrokerName = image_str_at(strs_p, hdr_p->strSize, hdr_p->statsBrokerName, &ok);
+	p = map_p + sizeof(IMGheader_t);
+
+	if (hdr_p->brokerCnt > 0) {
+		cfg_p->brokerInfo = (BROKERinfo_t*)calloc(hdr_p->brokerCnt, sizeof(BROKERinfo_t));
+		if (cfg_p->brokerInfo == NULL) {
+			perror("calloc(broker)");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i=0; i<(int)hdr_p->brokerCnt; ++i, p+=sizeof(IMGbroker_t)) {
+		broker_p = (const IMGbroker_t*)p;
+		cfg_p->brokerInfo[i].loop.epollFd = -1;
+		cfg_p->brokerInfo[i].port = broker_p->port;
+		cfg_p->brokerInfoCnt = i + 1;
+		name_p = image_str_at(strs_p, hdr_p->strSize, broker_p->name, &ok);
+		server_p = image_str_at(strs_p, hdr_p->strSize, broker_p->server, &ok);
+		clientId_p = image_str_at(strs_p, hdr_p->strSize, broker_p->clientId, &ok);
+		if (!ok || (name_p == NULL) || (server_p == NULL)) {
+			ok = false;
+			break;
+		}
+		cfg_p->brokerInfo[i].brokerName = strdup(name_p);
+		cfg_p->brokerInfo[i].server = strdup(server_p);
+		if (clientId_p != NULL)
+			cfg_p->brokerInfo[i].clientId = strdup(clientId_p);
+		if ((cfg_p->brokerInfo[i].brokerName == NULL) || (cfg_p->brokerInfo[i].server == NULL)
+				|| ((broker_p->clientId != 0) && (cfg_p->brokerInfo[i].clientId == NULL))) {
+			perror("strdup(broker)");
+			exit(EXIT_FAILURE);
+		}
+	}
+	p = map_p + sizeof(IMGheader_t) + hdr_p->brokerCnt * sizeof(IMGbroker_t);
+
+	cfg_p->gpioInfoCnt = hdr_p->gpioCnt;
+	cfg_p->gpioInfo = (GPIOinfo_t*)arena_alloc(&cfg_p->arena, hdr_p->gpioCnt * sizeof(GPIOinfo_t), ARENA_ALIGN);
+	for (i=0; i<cfg_p->gpioInfoCnt; ++i, p+=sizeof(IMGgpio_t)) {
+		gpio_p = (const IMGgpio_t*)p;
+		cfg_p->gpioInfo[i].gpioName = image_str_at(strs_p, hdr_p->strSize, gpio_p->name, &ok);
+		cfg_p->gpioInfo[i].chipStr = image_str_at(strs_p, hdr_p->strSize, gpio_p->chip, &ok);
+		cfg_p->gpioInfo[i].stateTopic = image_str_at(strs_p, hdr_p->strSize, gpio_p->stateTopic, &ok);
+		cfg_p->gpioInfo[i].brokerName = image_str_at(strs_p, hdr_p->strSize, gpio_p->brokerName, &ok);
+		cfg_p->gpioInfo[i].pin = gpio_p->pin;
+		ok = ok && (cfg_p->gpioInfo[i].gpioName != NULL) && (cfg_p->gpioInfo[i].chipStr != NULL);
+	}
+	cfg_p->cmdInfoCnt = hdr_p->cmdCnt;
+	cfg_p->cmdInfo = (CMDinfo_t*)arena_alloc(&cfg_p->arena, hdr_p->cmdCnt * sizeof(CMDinfo_t), ARENA_ALIGN);
+	for (i=0; i<cfg_p->cmdInfoCnt; ++i, p+=sizeof(IMGcmd_t)) {
+		cmd_p = (const IMGcmd_t*)p;
+		cfg_p->cmdInfo[i].actionName = image_str_at(strs_p, hdr_p->strSize, cmd_p->name, &ok);
+		cfg_p->cmdInfo[i].cmdStr = image_str_at(strs_p, hdr_p->strSize, cmd_p->cmdStr, &ok);
+		cfg_p->cmdInfo[i].replyTopic = image_str_at(strs_p, hdr_p->strSize, cmd_p->replyTopic, &ok);
+		cfg_p->cmdInfo[i].brokerName = image_str_at(strs_p, hdr_p->strSize, cmd_p->brokerName, &ok);
+		cfg_p->cmdInfo[i].persistent = (cmd_p->persistent != 0);
+		cfg_p->cmdInfo[i].maxChildren = cmd_p->maxChildren;
+		cfg_p->cmdInfo[i].queueMax = cmd_p->queueMax;
+		cfg_p->cmdInfo[i].restart = (cmd_p->restart != 0);
+		ok = ok && (cfg_p->cmdInfo[i].actionName != NULL) && (cfg_p->cmdInfo[i].cmdStr != NULL)
+			&& (cfg_p->cmdInfo[i].maxChildren > 0) && (cfg_p->cmdInfo[i].queueMax >= 0);
+	}
+	cfg_p->inputInfoCnt = hdr_p->inputCnt;
+	cfg_p->inputInfo = (INPUTinfo_t*)arena_alloc(&cfg_p->arena, hdr_p->inputCnt * sizeof(INPUTinfo_t), ARENA_ALIGN);
+	for (i=0; i<cfg_p->inputInfoCnt; ++i, p+=sizeof(IMGinput_t)) {
+		input_p = (const IMGinput_t*)p;
+		cfg_p->inputInfo[i].inputName = image_str_at(strs_p, hdr_p->strSize, input_p->name, &ok);
+		cfg_p->inputInfo[i].chipStr = image_str_at(strs_p, hdr_p->strSize, input_p->chip, &ok);
+		cfg_p->inputInfo[i].pin = input_p->pin;
+		cfg_p->inputInfo[i].debounceMs = input_p->debounceMs;
+		ok = ok && (cfg_p->inputInfo[i].inputName != NULL) && (cfg_p->inputInfo[i].chipStr != NULL);
+	}
+	cfg_p->pubInfoCnt = hdr_p->pubCnt;
+	cfg_p->pubInfo = (PUBinfo_t*)arena_alloc(&cfg_p->arena, hdr_p->pubCnt * sizeof(PUBinfo_t), ARENA_ALIGN);
+	for (i=0; i<cfg_p->pubInfoCnt; ++i, p+=sizeof(IMGpub_t)) {
+		pub_p = (const IMGpub_t*)p;
+		cfg_p->pubInfo[i].topicStr = image_str_at(strs_p, hdr_p->strSize, pub_p->topic, &ok);
+		cfg_p->pubInfo[i].inputName = image_str_at(strs_p, hdr_p->strSize, pub_p->input, &ok);
+		cfg_p->pubInfo[i].brokerName = image_str_at(strs_p, hdr_p->strSize, pub_p->brokerName, &ok);
+		cfg_p->pubInfo[i].qos = pub_p->qos;
+		cfg_p->pubInfo[i].inv = pub_p->inv;
+		cfg_p->pubInfo[i].coalesceMs = pub_p->coalesceMs;
+		cfg_p->pubInfo[i].rateMax = pub_p->rateMax;
+		cfg_p->pubInfo[i].count = pub_p->count;
+		ok = ok && (cfg_p->pubInfo[i].topicStr != NULL) && (cfg_p->pubInfo[i].inputName != NULL)
+			&& (cfg_p->pubInfo[i].qos >= 0) && (cfg_p->pubInfo[i].qos <= 2);
+	}
+	cfg_p->subInfoCnt = hdr_p->subCnt;
+	cfg_p->subInfo = (SUBinfo_t*)arena_alloc(&cfg_p->arena, hdr_p->subCnt * sizeof(SUBinfo_t), ARENA_ALIGN);
+	for (i=0; i<cfg_p->subInfoCnt; ++i, p+=sizeof(IMGsub_t)) {
+		sub_p = (const IMGsub_t*)p;
+		cfg_p->subInfo[i].topicStr = image_str_at(strs_p, hdr_p->strSize, sub_p->topic, &ok);
+		cfg_p->subInfo[i].gpioName = image_str_at(strs_p, hdr_p->strSize, sub_p->name, &ok);
+		cfg_p->subInfo[i].brokerName = image_str_at(strs_p, hdr_p->strSize, sub_p->brokerName, &ok);
+		cfg_p->subInfo[i].qos = sub_p->qos;
+		cfg_p->subInfo[i].inv = sub_p->inv;
+		ok = ok && (cfg_p->subInfo[i].topicStr != NULL) && (cfg_p->subInfo[i].gpioName != NULL)
+			&& (cfg_p->subInfo[i].qos >= 0) && (cfg_p->subInfo[i].qos <= 2);
+	}
+	cfg_p->sceneInfoCnt = hdr_p->sceneCnt;
+	cfg_p->sceneInfo = (SCENEinfo_t*)arena_alloc(&cfg_p->arena, hdr_p->sceneCnt * sizeof(SCENEinfo_t), ARENA_ALIGN);
+	set_p = (const IMGsceneSet_t*)(p + hdr_p->sceneCnt * sizeof(IMGscene_t));
+	setCnt = 0;
+	for (i=0; i<cfg_p->sceneInfoCnt; ++i, p+=sizeof(IMGscene_t)) {
+		scene_p = (const IMGscene_t*)p;
+		cfg_p->sceneInfo[i].topicStr = image_str_at(strs_p, hdr_p->strSize, scene_p->topic, &ok);
+		cfg_p->sceneInfo[i].payload = image_str_at(strs_p, hdr_p->strSize, scene_p->payload, &ok);
+		cfg_p->sceneInfo[i].brokerName = image_str_at(strs_p, hdr_p->strSize, scene_p->brokerName, &ok);
+		cfg_p->sceneInfo[i].qos = scene_p->qos;
+		ok = ok && (cfg_p->sceneInfo[i].topicStr != NULL) && (cfg_p->sceneInfo[i].payload != NULL)
+			&& (cfg_p->sceneInfo[i].qos >= 0) && (cfg_p->sceneInfo[i].qos <= 2) && (scene_p->setCnt > 0) && ((uint32_t)scene_p->setCnt <= hdr_p->sceneSetCnt - setCnt);
+		if (!ok)
+			break;
+		cfg_p->sceneInfo[i].setCnt = scene_p->setCnt;
+		cfg_p->sceneInfo[i].set = (SCENEset_t*)arena_alloc(&cfg_p->arena, scene_p->setCnt * sizeof(SCENEset_t), ARENA_ALIGN);
+		for (k=0; k<scene_p->setCnt; ++k, ++set_p) {
+			cfg_p->sceneInfo[i].set[k].gpioName = image_str_at(strs_p, hdr_p->strSize, set_p->gpioName, &ok);
+			cfg_p->sceneInfo[i].set[k].val = (set_p->val != 0);
+			ok = ok && (cfg_p->sceneInfo[i].set[k].gpioName != NULL);
+		}
+		setCnt += scene_p->setCnt;
+	}
+	ok = ok && (setCnt == hdr_p->sceneSetCnt);
+	munmap((void*)map_p, statInfo.st_size);
+
+	if (!ok) {
+		log_warning("%s: not a usable image, ignored\n", imageFile);
+		free_brokers(cfg_p);
+		arena_free(&cfg_p->arena);
+		return false;
+	}
+	log_info("config from %s\n", imageFile);
+	return true;
+}
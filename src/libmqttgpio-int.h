@@ -0,0 +1,664 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// what the parts of libmqttgpio share: the types of the config, its
+// dispatch tables and the instance, the loop and the timer wheel, and the
+// functions one part calls in another; libmqttgpio.h is the API, this
+// is for the library itself and for the bench
+
+#ifndef LIBMQTTGPIO_INT_H
+#define LIBMQTTGPIO_INT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <mosquitto.h>
+
+#include "config.h"
+#include "libmqttgpio.h"
+#include "gpio-backend.h"
+
+#define NOTU __attribute__((unused))
+#define DEFAULT_BROKER_NAME "default"
+#define ACTION_RING_SIZE 65536
+#define VAL_TOGGLE 2
+#define RING_PAYLOAD_MAX 1024
+#define HELPER_QUEUE_MAX 65536
+#define HELPER_REPLY_MAX 1024
+#define METRICS_CONN_MAX 4
+#define METRICS_REQ_MAX 1024
+#define SHARD_MAX 16
+#define WHEEL_TICK_MS 10
+#define WHEEL_SLOTS 512
+#define HIST_BUCKETS 112
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define IMAGE_SUFFIX ".img"
+
+// levels above LOG_LEVEL_MAX (./configure --with-max-log-level) compile
+// to nothing, arguments included; the rest are filtered at runtime by -V
+#ifndef LOG_LEVEL_MAX
+# define LOG_LEVEL_MAX LOG_DEBUG
+#endif
+#define log_on(lvl) (((lvl) <= LOG_LEVEL_MAX) && ((lvl) <= logLevel_G))
+#define log_msg(lvl, ...) do { if (log_on(lvl)) log_write((lvl), __VA_ARGS__); } while (0)
+#define log_err(...) log_msg(LOG_ERR, __VA_ARGS__)
+#define log_warning(...) log_msg(LOG_WARNING, __VA_ARGS__)
+#define log_notice(...) log_msg(LOG_NOTICE, __VA_ARGS__)
+#define log_info(...) log_msg(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) log_msg(LOG_DEBUG, __VA_ARGS__)
+
+// everything the daemon waits on (broker socket, signals, timers) is a
+// LOOPwatch_t on one epoll set, its callback runs when the fd is ready
+typedef void (*LOOPcb_t)(MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+
+typedef struct {
+	int fd;
+	bool isTimer;
+	LOOPcb_t cb;
+	void *data_p;
+} LOOPwatch_t;
+
+typedef struct {
+	int epollFd;
+	atomic_bool quit;
+
+	// handed to every callback
+	MQTTGPIO_t *ctx_p;
+
+	// run after each batch of callbacks
+	LOOPcb_t post;
+	void *postData_p;
+
+	// watches removed during a batch are freed after it
+	LOOPwatch_t **dead;
+	int deadCnt;
+} LOOP_t;
+
+// a hashed timer wheel on a shard's loop: WHEEL_SLOTS circular lists of
+// WHEEL_TICK_MS each, an entry more than one turn out stays in its slot
+// until its tick comes round; nodes are embedded in whatever they time,
+// prev == NULL means not scheduled
+typedef struct WHEELnode {
+	struct WHEELnode *prev;
+	struct WHEELnode *next;
+	uint64_t expireTick;
+} WHEELnode_t;
+
+typedef struct WHEEL {
+	WHEELnode_t slots[WHEEL_SLOTS];
+	uint64_t curTick;
+	int cnt;
+	LOOPwatch_t *timer_p;
+
+	// fire runs per expired node, done once after each tick's batch
+	void (*fire)(MQTTGPIO_t *ctx_p, WHEELnode_t *node_p);
+	void (*done)(MQTTGPIO_t *ctx_p, struct WHEEL *wheel_p);
+} WHEEL_t;
+
+// latencies in microseconds: exact below 4us, then 4 buckets per power of
+// two (at most 25% wide) up to ~9 minutes; counters are relaxed atomics so
+// any thread can record and a dump can read while they do
+typedef struct {
+	atomic_ulong cnt[HIST_BUCKETS];
+	atomic_ulong max;
+	atomic_ulong sum;
+} HIST_t;
+
+// the stages of a message, from process_message() on the broker thread to
+// the end of the main thread's batch
+enum {
+	STAT_DECODE,	// broker thread: parsed and queued
+	STAT_QUEUE,	// arrival to the main thread picking it up
+	STAT_WRITE,	// one set-values call (per chip, not per message)
+	STAT_PIN,	// arrival to its pins written
+	STAT_SPAWN,	// one posix_spawn() of a CMD
+	STAT_TOTAL,	// arrival to everything it asked for done
+	STAT_CNT,
+};
+
+// a config's memory: tables and strings are bump-allocated from a chain of
+// zeroed blocks and all freed together; strings are interned, within one
+// config the same name is the same pointer
+typedef struct ARENAblock {
+	struct ARENAblock *next;
+	size_t size;
+	size_t used;
+	max_align_t data[];
+} ARENAblock_t;
+
+typedef struct {
+	ARENAblock_t *block_p;
+	const char **strs;
+	uint32_t strMask;
+	uint32_t strCnt;
+} ARENA_t;
+
+// one open handle per gpiochip, however many ways the config names it;
+// its pins belong to one shard, for as long as it's open
+typedef struct {
+	char *name;
+	GPIOchip_t *chip;
+	char **aliases;
+	int aliasCnt;
+	int shard;
+	atomic_ulong writeCnt;
+} CHIPinfo_t;
+
+typedef struct {
+	const char *gpioName;
+	const char *chipStr;
+	int chipIdx;
+	int pin;
+
+	// which bulk request this line belongs to, and where in it
+	int bulkIdx;
+	unsigned bulkPos;
+
+	// optional retained ON/OFF echo of the line's value
+	const char *stateTopic;
+	const char *brokerName;
+	int brokerIdx;
+	bool statePending;
+	int stateWas;
+
+	// the value to go back to at the end of an ON <s>/OFF <s>/PULSE <ms>
+	WHEELnode_t revert;
+	int revertVal;
+} GPIOinfo_t;
+
+// all the output lines of one chip (up to GPIO_OUT_MAX) are requested
+// together so that every write from one message is one ioctl; 'values' is
+// what's staged, 'written' what the lines were last set to, 'req' is NULL
+// until the request is made
+typedef struct {
+	int chipIdx;
+	GPIOout_t *req;
+	unsigned offsets[GPIO_OUT_MAX];
+	unsigned lineCnt;
+	int values[GPIO_OUT_MAX];
+	int written[GPIO_OUT_MAX];
+	bool dirty;
+} BULKinfo_t;
+
+// a line watched for edges, its debounced level goes out on its PUB topics
+typedef struct {
+	const char *inputName;
+	const char *chipStr;
+	int chipIdx;
+	int pin;
+	int debounceMs;
+	GPIOin_t *line;
+	bool debounced;	// by the kernel, every edge read is a settled level
+	LOOPwatch_t *watch_p;
+	LOOPwatch_t *debounceTimer_p;
+	int value;
+
+	// resolved at startup by init_dispatch()
+	int *pubIdx;
+	int pubIdxCnt;
+} INPUTinfo_t;
+
+// a PERSISTENT CMD's helper: one end of a socket pair is its stdin (and,
+// with REPLY=, its stdout), triggers queue in 'out' while it's busy, the
+// lines it writes are put together in 'reply'; it outlives a reload along
+// with the pid
+typedef struct {
+	int cmd;
+	int fd;
+	LOOPwatch_t *watch_p;
+	size_t outLen;
+	size_t replyLen;
+	unsigned long dropped;
+	char reply[HELPER_REPLY_MAX];
+	char out[HELPER_QUEUE_MAX];
+} HELPER_t;
+
+// one running process of a CMD, killDeadline is non-zero while a
+// SIGTERM'ed child is given time to exit, UINT64_MAX once it's SIGKILL'ed
+typedef struct {
+	pid_t pid;
+	uint64_t killDeadline;
+} CMDchild_t;
+
+typedef struct {
+	const char *actionName;
+	const char *cmdStr;
+	bool valid;
+
+	// at most maxChildren at once, oldest first; a trigger that finds them
+	// all busy restarts the oldest, is queued (up to queueMax) or dropped
+	int maxChildren;
+	int queueMax;
+	bool restart;
+	CMDchild_t *child;
+	int childCnt;
+	int pending;
+	unsigned long dropped;
+
+	// PERSISTENT: started once, every message is a line on its stdin, and
+	// with REPLY= every line it writes is published
+	bool persistent;
+	const char *replyTopic;
+	const char *brokerName;
+	int brokerIdx;
+	HELPER_t *helper_p;
+
+	// cmdStr split on whitespace by init_CMDinfo(), argv[] points into argvBuf
+	char *argvBuf;
+	char **argv;
+} CMDinfo_t;
+
+typedef struct {
+	const char *topicStr;
+	const char *gpioName;
+	int qos;
+	bool inv;
+	const char *brokerName;
+
+	// resolved at startup by init_dispatch()
+	int brokerIdx;
+	int *gpioIdx;
+	int gpioIdxCnt;
+	int *cmdIdx;
+	int cmdIdxCnt;
+	int helperCnt;
+} SUBinfo_t;
+
+// a SCENE: one payload on one topic sets a pattern of GPIOs, however many
+// chips they're spread over
+typedef struct {
+	const char *gpioName;
+	int val;
+} SCENEset_t;
+
+// the lines of one bulk request a scene writes, and what it writes to them
+typedef struct {
+	int bulkIdx;
+	uint64_t mask;
+	uint64_t bits;
+} SCENEbulk_t;
+
+_Static_assert(GPIO_OUT_MAX <= 64, "a scene's mask covers a bulk request in one word");
+
+typedef struct {
+	const char *topicStr;
+	const char *payload;
+	int qos;
+	const char *brokerName;
+	SCENEset_t *set;
+	int setCnt;
+
+	// resolved by init_dispatch(): the GPIOs it drives, and its pattern
+	// as one mask per bulk request, in bulk order
+	int brokerIdx;
+	int *gpioIdx;
+	int gpioIdxCnt;
+	SCENEbulk_t *bulk;
+	int bulkCnt;
+} SCENEinfo_t;
+
+typedef struct {
+	const char *topicStr;
+	const char *inputName;
+	int qos;
+	bool inv;
+	const char *brokerName;
+	int brokerIdx;
+
+	// publish policy: hold changes for a window, cap the rate, or send
+	// the number of edges since the last publish instead of the level
+	int coalesceMs;
+	int rateMax;
+	bool count;
+
+	// policy state, the timer exists only if there's a window or rate
+	LOOPwatch_t *timer_p;
+	bool pending;
+	int pendingVal;
+	unsigned long pendingCnt;
+	int lastVal;
+	uint64_t windowEnd;
+	uint64_t tokens;
+	uint64_t tokensAt;
+} PUBinfo_t;
+
+// one entry per unique (broker, topic string), the SUBs and SCENEs that
+// share it
+typedef struct {
+	const char *topicStr;
+	int brokerIdx;
+	uint32_t hash;
+	int qos;
+	int *subIdx;
+	int subIdxCnt;
+	int *sceneIdx;
+	int sceneIdxCnt;
+
+	// arrival to done for the messages it matched, kept over a reload
+	// (only the main thread records these)
+	HIST_t hist;
+} TOPICinfo_t;
+
+// SUB topic filters split on '/' into a trie, '+' and '#' levels hang off
+// their parent directly, the other levels are found through an edge hash
+// keyed on (parent node, level string)
+typedef struct {
+	int plusChild;
+	int hashChild;
+	int topicIdx;
+} TRIEnode_t;
+
+typedef struct {
+	int parent;
+	int child;
+	uint32_t hash;
+	const char *level_p;
+	size_t len;
+} TRIEedge_t;
+
+// what a broker thread hands the main thread: a decoded message (val is
+// 0/1/VAL_TOGGLE or -1 if it's none of those, durMs non-zero for a timed
+// one) or a connect (val is the session-present flag); the payload, for
+// SCENEs and PERSISTENT CMDs, follows the topic (payloadLen 0 if it's too
+// long); records are 8-byte aligned, len 0 means the rest of the ring is
+// padding
+enum {
+	ACTION_MSG,
+	ACTION_CONNECTED,
+};
+
+typedef struct {
+	uint32_t len;
+	uint32_t durMs;
+	uint64_t recvNs;
+	uint8_t type;
+	int8_t val;
+	uint16_t topicLen;
+	uint16_t payloadLen;
+	char topic[];
+} ACTIONrec_t;
+
+// single producer (the broker thread), single consumer (the main thread),
+// head and tail are free-running byte counts; with SHARDS each shard
+// thread reads it too, with its own tail, and a record's room is only
+// reused once every one of them is past it
+typedef struct {
+	unsigned char *buf;
+	size_t mask;
+	atomic_size_t head;
+	atomic_size_t tail;
+	atomic_size_t shardTail[SHARD_MAX];
+	int shardCnt;
+	atomic_ulong dropped;
+} RING_t;
+
+// the smallest record ring_push() makes, bounds the records in a ring
+#define RING_REC_MIN ((sizeof(ACTIONrec_t) + 2 + 7) & ~(size_t)7)
+
+// one broker connection, each runs its own loop on its own thread so a
+// slow link only ever delays its own traffic; the table is created from
+// the first config and carried over unchanged by reloads
+typedef struct {
+	char *brokerName;
+	char *server;
+	int port;
+	char *clientId;
+	int brokerIdx;
+	MQTTGPIO_t *ctx_p;
+
+	struct mosquitto *mosq;
+	pthread_t thread;
+	bool threadStarted;
+	LOOP_t loop;
+	LOOPwatch_t *wakeWatch_p;
+	LOOPwatch_t *watch_p;
+	LOOPwatch_t *miscTimer_p;
+	LOOPwatch_t *reconnectTimer_p;
+	int reconnectSec;
+
+	// process_message() and connect_callback() only queue, the main
+	// thread does the work; 'pushed' batches the wakeups per loop pass
+	RING_t ring;
+	bool pushed;
+	size_t batchEnd;
+	atomic_bool connected;
+	bool resubscribe;
+
+	// counted on the broker's thread, read by the metrics endpoint
+	atomic_ulong msgCnt;
+	atomic_ulong connectCnt;
+	atomic_ulong lostCnt;
+} BROKERinfo_t;
+
+// everything read from the config file, plus the dispatch tables built
+// from it, a reload builds a new one and diffs it against the live one;
+// all of it but the broker table (which outlives reloads) is in the arena
+typedef struct {
+	ARENA_t arena;
+	BROKERinfo_t *brokerInfo;
+	int brokerInfoCnt;
+	int cmdGraceMs;
+	int cmdMax;
+	GPIOinfo_t *gpioInfo;
+	int gpioInfoCnt;
+	SUBinfo_t *subInfo;
+	int subInfoCnt;
+	SCENEinfo_t *sceneInfo;
+	int sceneInfoCnt;
+	CMDinfo_t *cmdInfo;
+	int cmdInfoCnt;
+	INPUTinfo_t *inputInfo;
+	int inputInfoCnt;
+	PUBinfo_t *pubInfo;
+	int pubInfoCnt;
+	TOPICinfo_t *topicInfo;
+	int topicInfoCnt;
+	int *topicHash;
+	uint32_t topicHashMask;
+	TRIEnode_t *trieNode;
+	int trieNodeCnt;
+	TRIEedge_t *trieEdge;
+	uint32_t trieEdgeMask;
+	int *matchBuf;
+
+	// optional latency summary published every statsSec
+	const char *statsTopic;
+	const char *statsBrokerName;
+	int statsBrokerIdx;
+	int statsSec;
+
+	// optional HTTP endpoint: "[address:]port" or a unix socket path
+	const char *metricsAddr;
+
+	// REALTIME: SCHED_FIFO priority of the main loop (0 is off), and the
+	// CPU it's pinned to (-1 is any)
+	int rtPrio;
+	int rtCpu;
+
+	// SHARDS: threads the pins are spread over (0 is the main loop)
+	int shardCnt;
+} CONFIG_t;
+
+// one scrape: the request is read up to its blank line, then the whole
+// response is rendered at once and sent as the socket takes it; when all
+// the slots are busy the oldest scrape is dropped
+typedef struct {
+	LOOPwatch_t *watch_p;
+	uint64_t startNs;
+	size_t inLen;
+	char in[METRICS_REQ_MAX];
+	char *out_p;
+	size_t outLen;
+	size_t outPos;
+} METRICSconn_t;
+
+// the pins of some chips and everything that writes them: what a batch
+// has staged and the pending set-backs; without SHARDS there's one, run
+// by the main loop, with them each has its own thread and loop, reads
+// every broker's ring from its own tail and only touches its own chips,
+// so nothing on its path is shared with another shard
+typedef struct {
+	int shardIdx;
+	LOOP_t loop;
+	LOOP_t *loop_p;		// its own, or the main loop
+	LOOPwatch_t *wakeWatch_p;
+	pthread_t thread;
+	bool threadStarted;
+	WHEEL_t wheel;
+	int *dirtyBulk;
+	int dirtyBulkCnt;
+	int *stateDirty;
+	int stateDirtyCnt;
+	int *matchBuf;
+
+	// per broker, where this pass ends; the arrival of the messages of
+	// the pass that reached this shard's pins
+	size_t *batchEnd;
+	uint64_t *pinRecvNs;
+	int pinRecvCnt;
+
+	// pin sets that found the pin already there, and chip writes that
+	// had nothing left to change by the end of their batch
+	atomic_ulong pinSkipCnt;
+	atomic_ulong writeSkipCnt;
+} SHARD_t;
+
+// one instance: the live config and what's been built from it, the main
+// loop and its watches; everything but the logger hangs off this
+struct MQTTGPIO {
+	char *configFile;
+	CONFIG_t *cfg;
+	CHIPinfo_t *chipInfo;
+	int chipInfoCnt;
+	BULKinfo_t *bulkInfo;
+	int bulkInfoCnt;
+
+	// fixed at startup; the CPUs the shard threads may run on are the
+	// process' own from before REALTIME pinned the main loop
+	SHARD_t *shard;
+	int shardCnt;
+	bool sharded;
+	cpu_set_t shardCpus;
+
+	// children of CMDs a reload dropped, not reaped yet
+	pid_t *strayPid;
+	int strayPidCnt;
+
+	// all our children (strays included), against CMDMAX
+	int childCnt;
+	unsigned long spawnCnt;
+	unsigned long spawnFailCnt;
+	unsigned long reapCnt;
+
+	// the metrics listener (and the address it was opened on), the
+	// scrapes in progress are the slots with a watch
+	char *metricsAddr;
+	LOOPwatch_t *metricsWatch_p;
+	METRICSconn_t metricsConn[METRICS_CONN_MAX];
+	atomic_ulong unhandledCnt;
+
+	// mqttgpio_set_realtime() over the config's REALTIME (rtSet), and
+	// whether the loop thread got SCHED_FIFO (at rtActivePrio)
+	bool rtSet;
+	int rtPrio;
+	int rtCpu;
+	bool rtActive;
+	int rtActivePrio;
+
+	LOOP_t mainLoop;
+	LOOPwatch_t *signalWatch_p;
+	LOOPwatch_t *cmdTimer_p;
+	LOOPwatch_t *actionWatch_p;
+	LOOPwatch_t *statsTimer_p;
+	HIST_t stageHist[STAT_CNT];
+	bool mosqInit;
+};
+
+// per process: the -V level, and the names of the stageHist[] entries
+extern int logLevel_G;
+extern const char *stageName_G[STAT_CNT];
+
+// libmqttgpio.c: lifecycle, the tables built from a config, brokers, the
+// loop, CMDs and INPUTs
+void log_write (int level, const char *fmt_p, ...) __attribute__((format(printf, 2, 3)));
+void broker_wake (BROKERinfo_t *broker_p);
+void free_brokers (CONFIG_t *cfg_p);
+int find_broker (const CONFIG_t *cfg_p, const char *name_p);
+int resolve_broker (const CONFIG_t *cfg_p, const char *name_p, const char *what_p);
+void *arena_alloc (ARENA_t *arena_p, size_t size, size_t align);
+const char *arena_intern (ARENA_t *arena_p, const char *str_p);
+void *arena_pack (ARENA_t *arena_p, void *tab_p, size_t size);
+void arena_free (ARENA_t *arena_p);
+void *grow_table (void *tab_p, int cnt, size_t elemSize, const char *what_p);
+uint64_t now_ns (void);
+LOOPwatch_t *loop_add (LOOP_t *loop_p, int fd, uint32_t events, LOOPcb_t cb, void *data_p);
+void loop_mod (LOOP_t *loop_p, LOOPwatch_t *watch_p, uint32_t events);
+void loop_del (LOOP_t *loop_p, LOOPwatch_t *watch_p);
+void loop_arm_timer (LOOPwatch_t *watch_p, uint64_t ms, uint64_t intervalMs);
+void loop_run (LOOP_t *loop_p);
+void wheel_init (WHEEL_t *wheel_p, LOOP_t *loop_p, void (*fire)(MQTTGPIO_t*, WHEELnode_t*),
+		void (*done)(MQTTGPIO_t*, WHEEL_t*));
+void wheel_add (WHEEL_t *wheel_p, WHEELnode_t *node_p, uint64_t ms);
+void wheel_del (WHEEL_t *wheel_p, WHEELnode_t *node_p);
+void start_cmd (MQTTGPIO_t *ctx_p, int cmd);
+void helper_send (MQTTGPIO_t *ctx_p, int cmd, const char *topic_p, const char *payload_p, size_t payloadLen);
+void stop_cmd (MQTTGPIO_t *ctx_p, int cmd);
+bool cmd_running (const CMDinfo_t *cmd_p);
+void subscribe_all (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p);
+
+// libmqttgpio-config.c: the text config
+bool process_config_file (const char *fileName_p, CONFIG_t *cfg_p);
+bool read_config (const char *fileName_p, CONFIG_t *cfg_p);
+bool validate_config (CONFIG_t *cfg_p);
+bool cmd_runnable (const char *name_p, const char *path_p);
+
+// libmqttgpio-image.c: the compiled config
+bool hash_file (const char *fileName_p, uint64_t *hash_p);
+bool write_config_image (CONFIG_t *cfg_p, uint64_t textHash, const char *imageFile_p);
+bool load_config_image (const char *fileName_p, CONFIG_t *cfg_p);
+
+// libmqttgpio-dispatch.c: from a broker thread's message to the pins
+uint32_t hash_str (const char *str_p);
+int lookup_topic (const CONFIG_t *cfg_p, int brokerIdx, const char *topic_p);
+int trie_child (CONFIG_t *cfg_p, int node, const char *level_p, size_t len, bool create);
+SHARD_t *chip_shard (MQTTGPIO_t *ctx_p, int chipIdx);
+void publish_state (MQTTGPIO_t *ctx_p, int gpio);
+void init_shards (MQTTGPIO_t *ctx_p);
+void start_shards (MQTTGPIO_t *ctx_p);
+void stop_shards (MQTTGPIO_t *ctx_p);
+void shard_counts (MQTTGPIO_t *ctx_p, unsigned long *pinSkip_p, unsigned long *writeSkip_p);
+void hist_add (HIST_t *hist_p, uint64_t ns);
+void process_message (struct mosquitto *mosq, void *userdata, const struct mosquitto_message *msg);
+bool ring_push (RING_t *ring_p, uint8_t type, int8_t val, uint32_t durMs, uint64_t recvNs, const char *topic_p, size_t topicLen,
+		const char *payload_p, size_t payloadLen);
+void action_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+void action_wake (MQTTGPIO_t *ctx_p);
+void ring_notify (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p);
+
+// libmqttgpio-metrics.c: STATS, SIGUSR1 and METRICS
+void hist_summary (HIST_t *hist_p, unsigned long *cnt_p, unsigned long *p50_p, unsigned long *p99_p, unsigned long *max_p);
+void stats_dump (MQTTGPIO_t *ctx_p);
+void stats_timer_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+void metrics_open (MQTTGPIO_t *ctx_p);
+void metrics_close (MQTTGPIO_t *ctx_p);
+void arm_stats_timer (MQTTGPIO_t *ctx_p);
+
+// for a program that stands in for the broker threads itself (the
+// bench): mqttgpio_start() without the connections, then one thread per
+// broker does what that broker's thread would, mqttgpio_inject() per
+// message (false if it was unhandled or the ring was full) and
+// mqttgpio_inject_flush() at the end of each pass; _pending() is what
+// of that broker's ring isn't read yet
+void mqttgpio_start_offline (MQTTGPIO_t *ctx_p);
+bool mqttgpio_inject (MQTTGPIO_t *ctx_p, int brokerIdx, const char *topic_p, const void *payload_p, size_t payloadLen);
+void mqttgpio_inject_flush (MQTTGPIO_t *ctx_p, int brokerIdx);
+size_t mqttgpio_inject_pending (MQTTGPIO_t *ctx_p, int brokerIdx);
+
+#endif
@@ -0,0 +1,564 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// what the latency histograms and counters are shown as: the SIGUSR1
+// dump, the STATS topic and the Prometheus endpoint
+
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+
+#include "libmqttgpio-int.h"
+
+const char *stageName_G[STAT_CNT] = {
+	[STAT_DECODE] = "decode",
+	[STAT_QUEUE] = "queue",
+	[STAT_WRITE] = "write",
+	[STAT_PIN] = "pin",
+	[STAT_SPAWN] = "spawn",
+	[STAT_TOTAL] = "total",
+};
+
+static void cmd_counts (MQTTGPIO_t *ctx_p, unsigned long *queued_p, unsigned long *dropped_p);
+static void stats_publish (MQTTGPIO_t *ctx_p);
+static void metrics_accept_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void metrics_conn_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void metrics_conn_close (MQTTGPIO_t *ctx_p, METRICSconn_t *conn_p);
+static bool metrics_respond (MQTTGPIO_t *ctx_p, METRICSconn_t *conn_p);
+static void metrics_render (MQTTGPIO_t *ctx_p, FILE *stream);
+static void metrics_head (FILE *stream, const char *name_p, const char *type_p, const char *help_p);
+static void metrics_labels (FILE *stream, const char *key1_p, const char *val1_p, const char *key2_p, const char *val2_p);
+static void metrics_value (FILE *stream, const char *name_p, const char *key1_p, const char *val1_p, const char *key2_p,
+		const char *val2_p, unsigned long val);
+static void metrics_hist (FILE *stream, const char *name_p, const char *key1_p, const char *val1_p, const char *key2_p,
+		const char *val2_p, HIST_t *hist_p);
+
+// percentiles are the top of the bucket they fall in (never above max)
+void
+hist_summary (HIST_t *hist_p, unsigned long *cnt_p, unsigned long *p50_p, unsigned long *p99_p, unsigned long *max_p)
+{
+	int i, msb;
+	unsigned long cnt[HIST_BUCKETS], total, sum, top;
+
+	total = 0;
+	for (i=0; i<HIST_BUCKETS; ++i) {
+		cnt[i] = atomic_load_explicit(&hist_p->cnt[i], memory_order_relaxed);
+		total += cnt[i];
+	}
+	*cnt_p = total;
+	*max_p = atomic_load_explicit(&hist_p->max, memory_order_relaxed);
+	*p50_p = *p99_p = 0;
+	if (total == 0)
+		return;
+
+	sum = 0;
+	for (i=0; i<HIST_BUCKETS; ++i) {
+		if (cnt[i] == 0)
+			continue;
+		sum += cnt[i];
+		if (i < 4)
+			top = i;
+		else {
+			msb = i / 4 + 1;
+			top = ((unsigned long)(4 + i % 4 + 1) << (msb - 2)) - 1;
+		}
+		if (top > *max_p)
+			top = *max_p;
+		if ((*p50_p == 0) && (sum * 2 >= total))
+			*p50_p = top;
+		if (sum * 100 >= total * 99) {
+			*p99_p = top;
+			break;
+		}
+	}
+}
+
+// SIGUSR1
+void
+stats_dump (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	unsigned long cnt, p50, p99, max, queued, dropped, pinSkip, writeSkip;
+
+	log_notice("latency (us)          count        p50        p99        max\n");
+	for (i=0; i<STAT_CNT; ++i) {
+		hist_summary(&ctx_p->stageHist[i], &cnt, &p50, &p99, &max);
+		log_notice("  %-16s %10lu %10lu %10lu %10lu\n", stageName_G[i], cnt, p50, p99, max);
+	}
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		hist_summary(&ctx_p->cfg->topicInfo[i].hist, &cnt, &p50, &p99, &max);
+		log_notice("  %-16s %10lu %10lu %10lu %10lu  (topic on '%s')\n", ctx_p->cfg->topicInfo[i].topicStr,
+				cnt, p50, p99, max, ctx_p->cfg->brokerInfo[ctx_p->cfg->topicInfo[i].brokerIdx].brokerName);
+	}
+	shard_counts(ctx_p, &pinSkip, &writeSkip);
+	log_notice("skipped: %lu pin set(s) already in place, %lu chip write(s) with nothing to change\n", pinSkip, writeSkip);
+	cmd_counts(ctx_p, &queued, &dropped);
+	log_notice("CMDs: %d process(es) running, %lu trigger(s) queued, %lu dropped\n", ctx_p->childCnt, queued, dropped);
+	fflush(stdout);
+}
+
+static void
+cmd_counts (MQTTGPIO_t *ctx_p, unsigned long *queued_p, unsigned long *dropped_p)
+{
+	int i;
+
+	*queued_p = *dropped_p = 0;
+	for (i=0; i<ctx_p->cfg->cmdInfoCnt; ++i) {
+		*queued_p += ctx_p->cfg->cmdInfo[i].pending;
+		*dropped_p += ctx_p->cfg->cmdInfo[i].dropped;
+	}
+}
+
+// one JSON object: {"stages":{"decode":{"count":..,"p50":..,"p99":..,
+// "max":..},...},"topics":{"<filter>":{...},...},"skipped":{"pins":..,
+// "writes":..},"cmds":{"running":..,"queued":..,"dropped":..}}, times in
+// microseconds
+static void
+stats_publish (MQTTGPIO_t *ctx_p)
+{
+	int i, n, ret;
+	char *buf_p = NULL;
+	const char *c_p;
+	size_t len = 0;
+	FILE *stream;
+	unsigned long cnt, p50, p99, max, queued, dropped, pinSkip, writeSkip;
+	BROKERinfo_t *broker_p;
+
+	if ((ctx_p->cfg->statsTopic == NULL) || (ctx_p->cfg->statsBrokerIdx < 0))
+		return;
+	broker_p = &ctx_p->cfg->brokerInfo[ctx_p->cfg->statsBrokerIdx];
+	if (!broker_p->connected)
+		return;
+
+	stream = open_memstream(&buf_p, &len);
+	if (stream == NULL) {
+		perror("open_memstream(stats)");
+		return;
+	}
+	fprintf(stream, "{\"stages\":{");
+	for (i=0; i<STAT_CNT; ++i) {
+		hist_summary(&ctx_p->stageHist[i], &cnt, &p50, &p99, &max);
+		fprintf(stream, "%s\"%s\":{\"count\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}",
+				i? "," : "", stageName_G[i], cnt, p50, p99, max);
+	}
+	fprintf(stream, "},\"topics\":{");
+	for (i=n=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		if (ctx_p->cfg->topicInfo[i].brokerIdx != ctx_p->cfg->statsBrokerIdx)
+			continue;
+		hist_summary(&ctx_p->cfg->topicInfo[i].hist, &cnt, &p50, &p99, &max);
+		fputs(n++? ",\"" : "\"", stream);
+		for (c_p = ctx_p->cfg->topicInfo[i].topicStr; *c_p != 0; ++c_p) {
+			if ((*c_p == '"') || (*c_p == '\\'))
+				fputc('\\', stream);
+			fputc(*c_p, stream);
+		}
+		fprintf(stream, "\":{\"count\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}", cnt, p50, p99, max);
+	}
+	shard_counts(ctx_p, &pinSkip, &writeSkip);
+	fprintf(stream, "},\"skipped\":{\"pins\":%lu,\"writes\":%lu}", pinSkip, writeSkip);
+	cmd_counts(ctx_p, &queued, &dropped);
+	fprintf(stream, ",\"cmds\":{\"running\":%d,\"queued\":%lu,\"dropped\":%lu}}", ctx_p->childCnt, queued, dropped);
+	fclose(stream);
+
+	ret = mosquitto_publish(broker_p->mosq, NULL, ctx_p->cfg->statsTopic, len, buf_p, 0, false);
+	if (ret != MOSQ_ERR_SUCCESS)
+		log_err("can't publish to '%s': %s\n", ctx_p->cfg->statsTopic, mosquitto_strerror(ret));
+	broker_wake(broker_p);
+	free(buf_p);
+}
+
+void
+stats_timer_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, NOTU void *data_p)
+{
+	stats_publish(ctx_p);
+}
+
+void
+arm_stats_timer (MQTTGPIO_t *ctx_p)
+{
+	uint64_t ms = (ctx_p->cfg->statsTopic != NULL)? (uint64_t)ctx_p->cfg->statsSec * 1000 : 0;
+
+	loop_arm_timer(ctx_p->statsTimer_p, ms, ms);
+}
+
+// (re)open the listener if the config's METRICS changed; a failure is
+// logged and leaves the daemon without one until the next reload
+void
+metrics_open (MQTTGPIO_t *ctx_p)
+{
+	int fd, one = 1;
+	char *c_p, host[64];
+	const char *addr_p = ctx_p->cfg->metricsAddr;
+	socklen_t addrLen;
+	struct sockaddr_un un;
+	struct sockaddr_in in;
+	struct stat statInfo;
+
+	if ((addr_p != NULL) && (ctx_p->metricsAddr != NULL) && (strcmp(addr_p, ctx_p->metricsAddr) == 0))
+		return;
+	metrics_close(ctx_p);
+	if (addr_p == NULL)
+		return;
+
+	// a path, or [address:]port
+	if (addr_p[0] == '/') {
+		memset(&un, 0, sizeof(un));
+		un.sun_family = AF_UNIX;
+		if (strlen(addr_p) >= sizeof(un.sun_path)) {
+			log_err("metrics: socket path '%s' too long\n", addr_p);
+			return;
+		}
+		strcpy(un.sun_path, addr_p);
+		if ((stat(addr_p, &statInfo) == 0) && S_ISSOCK(statInfo.st_mode))
+			unlink(addr_p);
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		addrLen = sizeof(un);
+	}
+	else {
+		memset(&in, 0, sizeof(in));
+		in.sin_family = AF_INET;
+		in.sin_addr.s_addr = htonl(INADDR_ANY);
+		c_p = strrchr(addr_p, ':');
+		if (c_p != NULL) {
+			snprintf(host, sizeof(host), "%.*s", (int)(c_p - addr_p), addr_p);
+			if (inet_pton(AF_INET, host, &in.sin_addr) != 1) {
+				log_err("metrics: '%s' isn't an IPv4 address\n", host);
+				return;
+			}
+		}
+		c_p = (c_p != NULL)? c_p + 1 : (char*)addr_p;
+		if ((atoi(c_p) <= 0) || (atoi(c_p) > 65535)) {
+			log_err("metrics: '%s' isn't a port\n", c_p);
+			return;
+		}
+		in.sin_port = htons((uint16_t)atoi(c_p));
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd >= 0)
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		addrLen = sizeof(in);
+	}
+	if (fd < 0) {
+		perror("socket(metrics)");
+		return;
+	}
+	if ((bind(fd, (addr_p[0] == '/')? (struct sockaddr*)&un : (struct sockaddr*)&in, addrLen) != 0) || (listen(fd, 8) != 0)) {
+		log_err("metrics: can't listen on '%s': %s\n", addr_p, strerror(errno));
+		close(fd);
+		return;
+	}
+
+	ctx_p->metricsAddr = strdup(addr_p);
+	if (ctx_p->metricsAddr == NULL) {
+		perror("strdup(metrics)");
+		exit(EXIT_FAILURE);
+	}
+	ctx_p->metricsWatch_p = loop_add(&ctx_p->mainLoop, fd, EPOLLIN, metrics_accept_cb, NULL);
+	log_notice("metrics on '%s'\n", addr_p);
+}
+
+void
+metrics_close (MQTTGPIO_t *ctx_p)
+{
+	int i, fd;
+
+	for (i=0; i<METRICS_CONN_MAX; ++i)
+		metrics_conn_close(ctx_p, &ctx_p->metricsConn[i]);
+	if (ctx_p->metricsWatch_p == NULL)
+		return;
+	fd = ctx_p->metricsWatch_p->fd;
+	loop_del(&ctx_p->mainLoop, ctx_p->metricsWatch_p);
+	close(fd);
+	if (ctx_p->metricsAddr[0] == '/')
+		unlink(ctx_p->metricsAddr);
+	ctx_p->metricsWatch_p = NULL;
+	free(ctx_p->metricsAddr);
+	ctx_p->metricsAddr = NULL;
+}
+
+static void
+metrics_accept_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, NOTU void *data_p)
+{
+	int i, fd;
+	METRICSconn_t *conn_p;
+
+	while ((fd = accept(ctx_p->metricsWatch_p->fd, NULL, NULL)) >= 0) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		conn_p = &ctx_p->metricsConn[0];
+		for (i=0; i<METRICS_CONN_MAX; ++i) {
+			if (ctx_p->metricsConn[i].watch_p == NULL) {
+				conn_p = &ctx_p->metricsConn[i];
+				break;
+			}
+			if (ctx_p->metricsConn[i].startNs < conn_p->startNs)
+				conn_p = &ctx_p->metricsConn[i];
+		}
+		metrics_conn_close(ctx_p, conn_p);
+		conn_p->watch_p = loop_add(&ctx_p->mainLoop, fd, EPOLLIN, metrics_conn_cb, conn_p);
+		conn_p->startNs = now_ns();
+	}
+	if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+		perror("accept(metrics)");
+}
+
+static void
+metrics_conn_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	ssize_t ret;
+	METRICSconn_t *conn_p = (METRICSconn_t*)data_p;
+
+	if (conn_p->out_p == NULL) {
+		ret = recv(conn_p->watch_p->fd, conn_p->in + conn_p->inLen, sizeof(conn_p->in) - 1 - conn_p->inLen, 0);
+		if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+			return;
+		if (ret <= 0) {
+			metrics_conn_close(ctx_p, conn_p);
+			return;
+		}
+		conn_p->inLen += ret;
+		conn_p->in[conn_p->inLen] = 0;
+		if ((strstr(conn_p->in, "\r\n\r\n") == NULL) && (strstr(conn_p->in, "\n\n") == NULL)
+				&& (conn_p->inLen < sizeof(conn_p->in) - 1))
+			return;
+		if (!metrics_respond(ctx_p, conn_p)) {
+			metrics_conn_close(ctx_p, conn_p);
+			return;
+		}
+		loop_mod(&ctx_p->mainLoop, conn_p->watch_p, EPOLLOUT);
+	}
+
+	while (conn_p->outPos < conn_p->outLen) {
+		ret = send(conn_p->watch_p->fd, conn_p->out_p + conn_p->outPos, conn_p->outLen - conn_p->outPos, MSG_NOSIGNAL);
+		if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+			return;
+		if (ret < 0)
+			break;
+		conn_p->outPos += ret;
+	}
+	metrics_conn_close(ctx_p, conn_p);
+}
+
+static void
+metrics_conn_close (MQTTGPIO_t *ctx_p, METRICSconn_t *conn_p)
+{
+	int fd;
+
+	if (conn_p->watch_p == NULL)
+		return;
+	fd = conn_p->watch_p->fd;
+	loop_del(&ctx_p->mainLoop, conn_p->watch_p);
+	close(fd);
+	free(conn_p->out_p);
+	memset(conn_p, 0, sizeof(METRICSconn_t));
+}
+
+// GET /metrics (or /) gets the text exposition format, anything else a
+// 404; the connection is closed after the response either way
+static bool
+metrics_respond (MQTTGPIO_t *ctx_p, METRICSconn_t *conn_p)
+{
+	bool found;
+	char *body_p = NULL;
+	size_t bodyLen = 0;
+	FILE *stream;
+
+	found = ((strncmp(conn_p->in, "GET /metrics", 12) == 0) && ((conn_p->in[12] == ' ') || (conn_p->in[12] == '?')))
+		|| (strncmp(conn_p->in, "GET / ", 6) == 0);
+	stream = open_memstream(&body_p, &bodyLen);
+	if (stream == NULL) {
+		perror("open_memstream(metrics)");
+		return false;
+	}
+	if (found)
+		metrics_render(ctx_p, stream);
+	else
+		fputs("not found\n", stream);
+	fclose(stream);
+
+	stream = open_memstream(&conn_p->out_p, &conn_p->outLen);
+	if (stream == NULL) {
+		perror("open_memstream(metrics)");
+		free(body_p);
+		return false;
+	}
+	fprintf(stream, "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+			"Content-Length: %zu\r\nConnection: close\r\n\r\n", found? "200 OK" : "404 Not Found", bodyLen);
+	fwrite(body_p, 1, bodyLen, stream);
+	fclose(stream);
+	free(body_p);
+	conn_p->outPos = 0;
+	return true;
+}
+
+// the Prometheus text format; broker and latency counters are relaxed
+// atomics written by whichever thread saw the event, the rest belong to
+// the main thread, which is also the one reading them here
+static void
+metrics_render (MQTTGPIO_t *ctx_p, FILE *stream)
+{
+	int i;
+	unsigned long cnt, p50, p99, max, queued, dropped, pinSkip, writeSkip;
+	BROKERinfo_t *broker_p;
+	TOPICinfo_t *topic_p;
+
+	metrics_head(stream, "mqttgpio_messages_total", "counter", "Messages received from the broker.");
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		metrics_value(stream, "mqttgpio_messages_total", "broker", broker_p->brokerName, NULL, NULL,
+				atomic_load_explicit(&broker_p->msgCnt, memory_order_relaxed));
+	}
+	metrics_head(stream, "mqttgpio_messages_dropped_total", "counter", "Messages dropped because the main thread was behind.");
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		metrics_value(stream, "mqttgpio_messages_dropped_total", "broker", broker_p->brokerName, NULL, NULL,
+				atomic_load_explicit(&broker_p->ring.dropped, memory_order_relaxed));
+	}
+	metrics_head(stream, "mqttgpio_broker_connects_total", "counter", "Successful (re)connects to the broker.");
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		metrics_value(stream, "mqttgpio_broker_connects_total", "broker", broker_p->brokerName, NULL, NULL,
+				atomic_load_explicit(&broker_p->connectCnt, memory_order_relaxed));
+	}
+	metrics_head(stream, "mqttgpio_broker_lost_total", "counter", "Connections lost and connect attempts failed.");
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		metrics_value(stream, "mqttgpio_broker_lost_total", "broker", broker_p->brokerName, NULL, NULL,
+				atomic_load_explicit(&broker_p->lostCnt, memory_order_relaxed));
+	}
+	metrics_head(stream, "mqttgpio_broker_connected", "gauge", "1 while connected to the broker.");
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		metrics_value(stream, "mqttgpio_broker_connected", "broker", broker_p->brokerName, NULL, NULL,
+				atomic_load_explicit(&broker_p->connected, memory_order_relaxed));
+	}
+
+	metrics_head(stream, "mqttgpio_topic_messages_total", "counter", "Messages matched per subscribed topic.");
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		topic_p = &ctx_p->cfg->topicInfo[i];
+		hist_summary(&topic_p->hist, &cnt, &p50, &p99, &max);
+		metrics_value(stream, "mqttgpio_topic_messages_total", "broker", ctx_p->cfg->brokerInfo[topic_p->brokerIdx].brokerName,
+				"topic", topic_p->topicStr, cnt);
+	}
+	metrics_head(stream, "mqttgpio_unhandled_payloads_total", "counter", "Messages with a payload nothing took.");
+	metrics_value(stream, "mqttgpio_unhandled_payloads_total", NULL, NULL, NULL, NULL,
+			atomic_load_explicit(&ctx_p->unhandledCnt, memory_order_relaxed));
+
+	metrics_head(stream, "mqttgpio_gpio_writes_total", "counter", "Bulk writes to the lines of a chip.");
+	for (i=0; i<ctx_p->chipInfoCnt; ++i)
+		metrics_value(stream, "mqttgpio_gpio_writes_total", "chip", ctx_p->chipInfo[i].name, NULL, NULL,
+				atomic_load_explicit(&ctx_p->chipInfo[i].writeCnt, memory_order_relaxed));
+	shard_counts(ctx_p, &pinSkip, &writeSkip);
+	metrics_head(stream, "mqttgpio_gpio_writes_skipped_total", "counter", "Chip writes skipped, nothing changed.");
+	metrics_value(stream, "mqttgpio_gpio_writes_skipped_total", NULL, NULL, NULL, NULL, writeSkip);
+	metrics_head(stream, "mqttgpio_gpio_pin_sets_skipped_total", "counter", "Pin sets skipped, the pin was already there.");
+	metrics_value(stream, "mqttgpio_gpio_pin_sets_skipped_total", NULL, NULL, NULL, NULL, pinSkip);
+
+	cmd_counts(ctx_p, &queued, &dropped);
+	metrics_head(stream, "mqttgpio_cmd_spawns_total", "counter", "CMD processes started.");
+	metrics_value(stream, "mqttgpio_cmd_spawns_total", NULL, NULL, NULL, NULL, ctx_p->spawnCnt);
+	metrics_head(stream, "mqttgpio_cmd_spawn_failures_total", "counter", "CMD processes that couldn't be started.");
+	metrics_value(stream, "mqttgpio_cmd_spawn_failures_total", NULL, NULL, NULL, NULL, ctx_p->spawnFailCnt);
+	metrics_head(stream, "mqttgpio_cmd_reaps_total", "counter", "CMD processes that exited and were reaped.");
+	metrics_value(stream, "mqttgpio_cmd_reaps_total", NULL, NULL, NULL, NULL, ctx_p->reapCnt);
+	metrics_head(stream, "mqttgpio_cmd_processes", "gauge", "CMD processes running.");
+	metrics_value(stream, "mqttgpio_cmd_processes", NULL, NULL, NULL, NULL, ctx_p->childCnt);
+	metrics_head(stream, "mqttgpio_cmd_triggers_queued", "gauge", "CMD triggers waiting for a process to exit.");
+	metrics_value(stream, "mqttgpio_cmd_triggers_queued", NULL, NULL, NULL, NULL, queued);
+	metrics_head(stream, "mqttgpio_cmd_triggers_dropped_total", "counter", "CMD triggers dropped, the CMD was busy.");
+	metrics_value(stream, "mqttgpio_cmd_triggers_dropped_total", NULL, NULL, NULL, NULL, dropped);
+	metrics_head(stream, "mqttgpio_realtime", "gauge", "1 while the main loop runs SCHED_FIFO.");
+	metrics_value(stream, "mqttgpio_realtime", NULL, NULL, NULL, NULL, ctx_p->rtActive);
+	metrics_head(stream, "mqttgpio_shards", "gauge", "Threads the pins are spread over, 0 if the main loop writes them.");
+	metrics_value(stream, "mqttgpio_shards", NULL, NULL, NULL, NULL, ctx_p->sharded? ctx_p->shardCnt : 0);
+
+	metrics_head(stream, "mqttgpio_stage_latency_seconds", "histogram", "Time spent per stage of a message.");
+	for (i=0; i<STAT_CNT; ++i)
+		metrics_hist(stream, "mqttgpio_stage_latency_seconds", "stage", stageName_G[i], NULL, NULL, &ctx_p->stageHist[i]);
+	metrics_head(stream, "mqttgpio_topic_latency_seconds", "histogram", "Arrival to done for the messages of a subscribed topic.");
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		topic_p = &ctx_p->cfg->topicInfo[i];
+		metrics_hist(stream, "mqttgpio_topic_latency_seconds", "broker", ctx_p->cfg->brokerInfo[topic_p->brokerIdx].brokerName,
+				"topic", topic_p->topicStr, &topic_p->hist);
+	}
+}
+
+static void
+metrics_head (FILE *stream, const char *name_p, const char *type_p, const char *help_p)
+{
+	fprintf(stream, "# HELP %s %s\n# TYPE %s %s\n", name_p, help_p, name_p, type_p);
+}
+
+// label values escaped the way the format wants: \\, \" and \n
+static void
+metrics_labels (FILE *stream, const char *key1_p, const char *val1_p, const char *key2_p, const char *val2_p)
+{
+	int i;
+	const char *key_p, *c_p;
+
+	for (i=0; i<2; ++i) {
+		key_p = (i == 0)? key1_p : key2_p;
+		if (key_p == NULL)
+			continue;
+		fprintf(stream, "%s%s=\"", (i == 0)? "" : ",", key_p);
+		for (c_p = (i == 0)? val1_p : val2_p; *c_p != 0; ++c_p) {
+			if (*c_p == '\n')
+				fputs("\\n", stream);
+			else {
+				if ((*c_p == '"') || (*c_p == '\\'))
+					fputc('\\', stream);
+				fputc(*c_p, stream);
+			}
+		}
+		fputc('"', stream);
+	}
+}
+
+static void
+metrics_value (FILE *stream, const char *name_p, const char *key1_p, const char *val1_p, const char *key2_p,
+		const char *val2_p, unsigned long val)
+{
+	fputs(name_p, stream);
+	if (key1_p != NULL) {
+		fputc('{', stream);
+		metrics_labels(stream, key1_p, val1_p, key2_p, val2_p);
+		fputc('}', stream);
+	}
+	fprintf(stream, " %lu\n", val);
+}
+
+// the HIST_t buckets summed up to every power of two microseconds, which
+// are bucket edges, from 4us to 2^28us (~4.5 minutes)
+static void
+metrics_hist (FILE *stream, const char *name_p, const char *key1_p, const char *val1_p, const char *key2_p,
+		const char *val2_p, HIST_t *hist_p)
+{
+	int i, k;
+	unsigned long sum = 0;
+
+	for (i=0, k=2; k<=28; ++k) {
+		for (; i<=(k - 2) * 4 + 3; ++i)
+			sum += atomic_load_explicit(&hist_p->cnt[i], memory_order_relaxed);
+		fprintf(stream, "%s_bucket{", name_p);
+		metrics_labels(stream, key1_p, val1_p, key2_p, val2_p);
+		fprintf(stream, ",le=\"%.6f\"} %lu\n", (double)(1ul << k) / 1000000, sum);
+	}
+	for (; i<HIST_BUCKETS; ++i)
+		sum += atomic_load_explicit(&hist_p->cnt[i], memory_order_relaxed);
+	fprintf(stream, "%s_bucket{", name_p);
+	metrics_labels(stream, key1_p, val1_p, key2_p, val2_p);
+	fprintf(stream, ",le=\"+Inf\"} %lu\n%s_sum{", sum, name_p);
+	metrics_labels(stream, key1_p, val1_p, key2_p, val2_p);
+	fprintf(stream, "} %.6f\n%s_count{", (double)atomic_load_explicit(&hist_p->sum, memory_order_relaxed) / 1000000, name_p);
+	metrics_labels(stream, key1_p, val1_p, key2_p, val2_p);
+	fprintf(stream, "} %lu\n", sum);
+}
@@ -0,0 +1,2892 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <malloc.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "libmqttgpio-int.h"
+
+#define LOG_SLOTS 1024
+#define LOG_TEXT_MAX 240
+#define MQTT_MISC_MS 1000
+#define RT_STACK_PREFAULT (256 * 1024)
+#define ARENA_BLOCK_SIZE 16384
+#define LOOP_MAX_EVENTS 16
+#define INPUT_EVENT_BATCH 16
+
+// log records are formatted into a fixed slot by the caller and written
+// out by the log thread, a full ring drops instead of blocking anyone;
+// each slot's sequence number says whose turn it is (a bounded MPSC
+// queue: any thread produces, the log thread consumes)
+typedef struct {
+	atomic_size_t seq;
+	uint8_t level;
+	uint16_t len;
+	char text[LOG_TEXT_MAX];
+} LOGslot_t;
+
+typedef struct {
+	LOGslot_t slots[LOG_SLOTS];
+	atomic_size_t head;
+	size_t tail;
+	atomic_ulong dropped;
+
+	// the log thread sleeps on wakeFd, a producer only writes to it if
+	// the thread said it's going to sleep
+	atomic_bool sleeping;
+	atomic_bool quit;
+	int wakeFd;
+	pthread_t thread;
+	bool running;
+	bool useSyslog;
+	bool journal;
+} LOG_t;
+
+// the log ring is per process, whatever the number of instances
+int logLevel_G = LOG_NOTICE;
+static LOG_t log_G;
+extern char **environ;
+
+// mosquitto_lib_init()/cleanup() are per process too
+static atomic_int mosqUsers_G = 0;
+
+static void log_init (bool useSyslog);
+static void log_stop (void);
+static void *log_thread (void *data_p);
+static void log_out (int level, const char *text_p, size_t len);
+static void init_tables (MQTTGPIO_t *ctx_p);
+static void init_SUBinfo (MQTTGPIO_t *ctx_p);
+static void init_GPIOinfo (MQTTGPIO_t *ctx_p);
+static void init_CMDinfo (MQTTGPIO_t *ctx_p, CONFIG_t *old_p);
+static void drop_INPUTinfo (MQTTGPIO_t *ctx_p, CONFIG_t *old_p);
+static void init_INPUTinfo (MQTTGPIO_t *ctx_p);
+static void init_PUBinfo (MQTTGPIO_t *ctx_p, CONFIG_t *old_p);
+static void init_dispatch (MQTTGPIO_t *ctx_p);
+static void init_scene (MQTTGPIO_t *ctx_p, int scene);
+static int add_topic (MQTTGPIO_t *ctx_p, int brokerIdx, const char *topicStr_p, int qos);
+static void update_subscriptions (MQTTGPIO_t *ctx_p, const CONFIG_t *old_p);
+static void reload_config (MQTTGPIO_t *ctx_p);
+static void keep_strays (MQTTGPIO_t *ctx_p, CONFIG_t *old_p);
+static void free_config (CONFIG_t *cfg_p);
+static void init_mosquitto (MQTTGPIO_t *ctx_p);
+static void init_ring (MQTTGPIO_t *ctx_p, int brokerIdx);
+static void *broker_thread (void *data_p);
+static void broker_wake_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void stop_brokers (MQTTGPIO_t *ctx_p);
+static bool same_brokers (const CONFIG_t *a_p, const CONFIG_t *b_p);
+static void init_trie (MQTTGPIO_t *ctx_p);
+static int *append_idx (int *idx_p, int *cnt_p, int val);
+static int get_chip (MQTTGPIO_t *ctx_p, const char *chipStr_p);
+static int get_bulk (MQTTGPIO_t *ctx_p, int gpio);
+static void init_mainloop (MQTTGPIO_t *ctx_p);
+static uint64_t now_ms (void);
+static void realtime_start (MQTTGPIO_t *ctx_p);
+static void prefault_stack (void);
+static void loop_close (LOOP_t *loop_p);
+static LOOPwatch_t *loop_add_timer (LOOP_t *loop_p, LOOPcb_t cb, void *data_p);
+static void wheel_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void carry_reverts (MQTTGPIO_t *ctx_p, CONFIG_t *old_p);
+static void signal_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void mqtt_attach (BROKERinfo_t *broker_p);
+static void mqtt_lost (BROKERinfo_t *broker_p, int ret);
+static void mqtt_socket_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void mqtt_misc_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void mqtt_reconnect_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void mqtt_post_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void arm_cmd_timer (MQTTGPIO_t *ctx_p);
+static void cmd_timer_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void input_event_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void input_debounce_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void publish_input (MQTTGPIO_t *ctx_p, int input);
+static void pub_try (MQTTGPIO_t *ctx_p, PUBinfo_t *pub_p);
+static void pub_timer_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static bool spawn_cmd (MQTTGPIO_t *ctx_p, int cmd, const posix_spawn_file_actions_t *actions_p);
+static void start_helper (MQTTGPIO_t *ctx_p, int cmd);
+static void helper_flush (MQTTGPIO_t *ctx_p, HELPER_t *helper_p);
+static void helper_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p);
+static void helper_reply (MQTTGPIO_t *ctx_p, HELPER_t *helper_p, size_t len);
+static void close_helper (MQTTGPIO_t *ctx_p, HELPER_t *helper_p);
+static void free_helper (MQTTGPIO_t *ctx_p, CMDinfo_t *cmd_p);
+static void stop_child (MQTTGPIO_t *ctx_p, CMDinfo_t *cmd_p, int child);
+static void run_pending (MQTTGPIO_t *ctx_p);
+static void supervise_cmds (MQTTGPIO_t *ctx_p);
+static void connect_callback (struct mosquitto *mosq, void *userdata, int result, int flags);
+
+void
+mqttgpio_log_start (int verbose, bool useSyslog)
+{
+	logLevel_G = (verbose > LOG_DEBUG - LOG_NOTICE)? LOG_DEBUG : LOG_NOTICE + verbose;
+	log_init(useSyslog);
+}
+
+void
+mqttgpio_log_stop (void)
+{
+	log_stop();
+}
+
+MQTTGPIO_t *
+mqttgpio_new (const char *configFile_p)
+{
+	MQTTGPIO_t *ctx_p;
+
+	ctx_p = (MQTTGPIO_t*)calloc(1, sizeof(MQTTGPIO_t));
+	if (ctx_p == NULL) {
+		perror("calloc(mqttgpio)");
+		return NULL;
+	}
+	ctx_p->mainLoop.epollFd = -1;
+
+	ctx_p->configFile = strdup(configFile_p);
+	ctx_p->cfg = (CONFIG_t*)calloc(1, sizeof(CONFIG_t));
+	if ((ctx_p->configFile == NULL) || (ctx_p->cfg == NULL)) {
+		perror("calloc(config)");
+		mqttgpio_free(ctx_p);
+		return NULL;
+	}
+	if (!read_config(ctx_p->configFile, ctx_p->cfg)) {
+		mqttgpio_free(ctx_p);
+		return NULL;
+	}
+	init_mainloop(ctx_p);
+	init_shards(ctx_p);
+	return ctx_p;
+}
+
+// check the config the way startup would (without touching the lines)
+// and write it out as <configFile>.img, which read_config() then prefers
+// for as long as the text file is unchanged
+bool
+mqttgpio_compile_config (const char *configFile_p)
+{
+	bool ok;
+	uint64_t textHash;
+	char imageFile[PATH_MAX];
+	CONFIG_t *cfg_p;
+
+	if (snprintf(imageFile, sizeof(imageFile), "%s%s", configFile_p, IMAGE_SUFFIX) >= (int)sizeof(imageFile)) {
+		log_err("%s: name too long\n", configFile_p);
+		return false;
+	}
+	cfg_p = (CONFIG_t*)calloc(1, sizeof(CONFIG_t));
+	if (cfg_p == NULL) {
+		perror("calloc(config)");
+		return false;
+	}
+
+	ok = hash_file(configFile_p, &textHash) && process_config_file(configFile_p, cfg_p) && validate_config(cfg_p)
+		&& write_config_image(cfg_p, textHash, imageFile);
+	if (ok)
+		log_notice("%s: %d GPIO(s), %d SUB(s), %d SCENE(s), %d CMD(s), %d INPUT(s), %d PUB(s) written to %s\n", configFile_p,
+				cfg_p->gpioInfoCnt, cfg_p->subInfoCnt, cfg_p->sceneInfoCnt, cfg_p->cmdInfoCnt, cfg_p->inputInfoCnt,
+				cfg_p->pubInfoCnt, imageFile);
+	free_config(cfg_p);
+	return ok;
+}
+
+// everything the loop dispatches on, from the config mqttgpio_new() read
+static void
+init_tables (MQTTGPIO_t *ctx_p)
+{
+	log_info("gpio backend: %s\n", gpioBackend_G);
+	init_GPIOinfo(ctx_p);
+	init_INPUTinfo(ctx_p);
+	init_CMDinfo(ctx_p, NULL);
+	init_SUBinfo(ctx_p);
+	init_PUBinfo(ctx_p, NULL);
+	init_dispatch(ctx_p);
+}
+
+void
+mqttgpio_start (MQTTGPIO_t *ctx_p)
+{
+	init_tables(ctx_p);
+	init_mosquitto(ctx_p);
+	arm_stats_timer(ctx_p);
+	metrics_open(ctx_p);
+	realtime_start(ctx_p);
+	start_shards(ctx_p);
+}
+
+void
+mqttgpio_start_offline (MQTTGPIO_t *ctx_p)
+{
+	int i;
+
+	if (ctx_p->cfg->brokerInfoCnt == 0) {
+		log_err("no MQTT broker configured\n");
+		exit(EXIT_FAILURE);
+	}
+	init_tables(ctx_p);
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i)
+		init_ring(ctx_p, i);
+	start_shards(ctx_p);
+}
+
+void
+mqttgpio_set_realtime (MQTTGPIO_t *ctx_p, int priority, int cpu)
+{
+	ctx_p->rtSet = true;
+	ctx_p->rtPrio = priority;
+	ctx_p->rtCpu = cpu;
+}
+
+void
+mqttgpio_run (MQTTGPIO_t *ctx_p)
+{
+	loop_run(&ctx_p->mainLoop);
+}
+
+// from any thread
+void
+mqttgpio_stop (MQTTGPIO_t *ctx_p)
+{
+	ctx_p->mainLoop.quit = true;
+	action_wake(ctx_p);
+}
+
+void
+mqttgpio_reload (MQTTGPIO_t *ctx_p)
+{
+	reload_config(ctx_p);
+}
+
+void
+mqttgpio_dump_stats (MQTTGPIO_t *ctx_p)
+{
+	stats_dump(ctx_p);
+}
+
+void
+mqttgpio_reap (MQTTGPIO_t *ctx_p)
+{
+	supervise_cmds(ctx_p);
+}
+
+// take SIGCHLD, SIGHUP, SIGUSR1, SIGTERM and SIGINT synchronously on the
+// loop; they're blocked in the calling thread, which should be the one
+// that goes on to mqttgpio_run() before starting any others (the children
+// started by start_cmd() reset their signal mask)
+void
+mqttgpio_watch_signals (MQTTGPIO_t *ctx_p)
+{
+	int fd;
+	sigset_t sigMask;
+
+	sigemptyset(&sigMask);
+	sigaddset(&sigMask, SIGCHLD);
+	sigaddset(&sigMask, SIGTERM);
+	sigaddset(&sigMask, SIGINT);
+	sigaddset(&sigMask, SIGHUP);
+	sigaddset(&sigMask, SIGUSR1);
+	if (pthread_sigmask(SIG_BLOCK, &sigMask, NULL) != 0) {
+		perror("pthread_sigmask()");
+		exit(EXIT_FAILURE);
+	}
+	fd = signalfd(-1, &sigMask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0) {
+		perror("signalfd()");
+		exit(EXIT_FAILURE);
+	}
+	ctx_p->signalWatch_p = loop_add(&ctx_p->mainLoop, fd, EPOLLIN, signal_cb, NULL);
+}
+
+// before log_init() (and after log_stop()) records go straight to stdout
+static void
+log_init (bool useSyslog)
+{
+	int ret;
+	size_t i;
+	sigset_t all, old;
+
+	for (i=0; i<LOG_SLOTS; ++i)
+		atomic_init(&log_G.slots[i].seq, i);
+	log_G.useSyslog = useSyslog;
+	log_G.journal = !useSyslog && (getenv("JOURNAL_STREAM") != NULL);
+	if (log_G.useSyslog)
+		openlog(PACKAGE, LOG_PID, LOG_DAEMON);
+
+	log_G.wakeFd = eventfd(0, EFD_CLOEXEC);
+	if (log_G.wakeFd < 0) {
+		perror("eventfd(log)");
+		exit(EXIT_FAILURE);
+	}
+
+	// signals belong to the main loop's signalfd
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&log_G.thread, NULL, log_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0) {
+		printf("can't start log thread: %s\n", strerror(ret));
+		exit(EXIT_FAILURE);
+	}
+	log_G.running = true;
+}
+
+// drains what's queued first
+static void
+log_stop (void)
+{
+	uint64_t one = 1;
+
+	if (!log_G.running)
+		return;
+	atomic_store(&log_G.quit, true);
+	if (write(log_G.wakeFd, &one, sizeof(one)) != sizeof(one))
+		perror("write(log)");
+	pthread_join(log_G.thread, NULL);
+	log_G.running = false;
+	close(log_G.wakeFd);
+	if (log_G.useSyslog)
+		closelog();
+}
+
+void
+log_write (int level, const char *fmt_p, ...)
+{
+	int ret;
+	size_t pos, seq;
+	uint64_t one = 1;
+	va_list ap;
+	LOGslot_t *slot_p;
+
+	va_start(ap, fmt_p);
+	if (!log_G.running) {
+		vprintf(fmt_p, ap);
+		va_end(ap);
+		fflush(stdout);
+		return;
+	}
+
+	pos = atomic_load_explicit(&log_G.head, memory_order_relaxed);
+	for (;;) {
+		slot_p = &log_G.slots[pos % LOG_SLOTS];
+		seq = atomic_load_explicit(&slot_p->seq, memory_order_acquire);
+		if (seq == pos) {
+			if (atomic_compare_exchange_weak_explicit(&log_G.head, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if ((ptrdiff_t)(seq - pos) < 0) {
+			va_end(ap);
+			atomic_fetch_add_explicit(&log_G.dropped, 1, memory_order_relaxed);
+			return;
+		}
+		else
+			pos = atomic_load_explicit(&log_G.head, memory_order_relaxed);
+	}
+
+	ret = vsnprintf(slot_p->text, LOG_TEXT_MAX, fmt_p, ap);
+	va_end(ap);
+	if (ret < 0)
+		ret = 0;
+	else if (ret >= LOG_TEXT_MAX)
+		ret = LOG_TEXT_MAX - 1;
+	while ((ret > 0) && (slot_p->text[ret - 1] == '\n'))
+		--ret;
+	slot_p->len = ret;
+	slot_p->level = level;
+	atomic_store_explicit(&slot_p->seq, pos + 1, memory_order_release);
+
+	// pairs with the fence in log_thread(): either it sees the record or
+	// we see that it's asleep
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&log_G.sleeping, memory_order_relaxed)
+			&& atomic_exchange_explicit(&log_G.sleeping, false, memory_order_relaxed))
+		if (write(log_G.wakeFd, &one, sizeof(one)) != sizeof(one))
+			perror("write(log)");
+}
+
+static void *
+log_thread (NOTU void *data_p)
+{
+	bool ready;
+	uint64_t cnt;
+	unsigned long dropped;
+	char msg[64];
+	LOGslot_t *slot_p;
+
+	for (;;) {
+		for (;;) {
+			slot_p = &log_G.slots[log_G.tail % LOG_SLOTS];
+			if (atomic_load_explicit(&slot_p->seq, memory_order_acquire) != log_G.tail + 1)
+				break;
+			log_out(slot_p->level, slot_p->text, slot_p->len);
+			atomic_store_explicit(&slot_p->seq, log_G.tail + LOG_SLOTS, memory_order_release);
+			++log_G.tail;
+		}
+		dropped = atomic_exchange_explicit(&log_G.dropped, 0, memory_order_relaxed);
+		if (dropped != 0)
+			log_out(LOG_WARNING, msg, snprintf(msg, sizeof(msg), "log: %lu message(s) dropped", dropped));
+		if (!log_G.useSyslog)
+			fflush(stdout);
+
+		atomic_store_explicit(&log_G.sleeping, true, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		ready = (atomic_load_explicit(&slot_p->seq, memory_order_relaxed) == log_G.tail + 1);
+		if (ready) {
+			atomic_store_explicit(&log_G.sleeping, false, memory_order_relaxed);
+			continue;
+		}
+		if (atomic_load(&log_G.quit))
+			break;
+		if (read(log_G.wakeFd, &cnt, sizeof(cnt)) < 0)
+			break;
+	}
+	return NULL;
+}
+
+// under systemd stdout is the journal, a "<level>" prefix gets it the
+// right priority
+static void
+log_out (int level, const char *text_p, size_t len)
+{
+	if (log_G.useSyslog)
+		syslog(level, "%.*s", (int)len, text_p);
+	else if (log_G.journal)
+		printf("<%d>%.*s\n", level, (int)len, text_p);
+	else
+		printf("%.*s\n", (int)len, text_p);
+}
+
+// on a reload the bulk requests whose lines are all still wanted are left
+// alone, the others are re-requested with just the lines that remain (at
+// their current values), lines new to the config go into fresh requests;
+// a line is its chip and offset, the chip handles are never reopened
+static void
+init_GPIOinfo (MQTTGPIO_t *ctx_p)
+{
+	int i, b, newCnt;
+	unsigned pos, keepCnt;
+	BULKinfo_t *bulk_p;
+	GPIOinfo_t *gpio_p;
+	SHARD_t *shard_p;
+
+	log_info("number of GPIO items: %d\n", ctx_p->cfg->gpioInfoCnt);
+
+	for (i=0; i<ctx_p->cfg->gpioInfoCnt; ++i) {
+		gpio_p = &ctx_p->cfg->gpioInfo[i];
+		if (log_on(LOG_INFO)) {
+			log_info("GPIO[%d]\n", i);
+			log_info("\tchip: %s\n", gpio_p->chipStr);
+			log_info("\tpin: %d\n", gpio_p->pin);
+		}
+
+		gpio_p->chipIdx = get_chip(ctx_p, gpio_p->chipStr);
+		if ((gpio_p->pin < 0) || ((unsigned)gpio_p->pin >= gpio_chip_lines(ctx_p->chipInfo[gpio_p->chipIdx].chip))) {
+			log_err("can't get pin: %d\n", gpio_p->pin);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	newCnt = 0;
+	for (b=0; b<ctx_p->bulkInfoCnt; ++b) {
+		bulk_p = &ctx_p->bulkInfo[b];
+		keepCnt = 0;
+		for (pos=0; pos<bulk_p->lineCnt; ++pos) {
+			for (i=0; i<ctx_p->cfg->gpioInfoCnt; ++i)
+				if ((ctx_p->cfg->gpioInfo[i].chipIdx == bulk_p->chipIdx)
+						&& ((unsigned)ctx_p->cfg->gpioInfo[i].pin == bulk_p->offsets[pos]))
+					break;
+			if (i == ctx_p->cfg->gpioInfoCnt)
+				continue;
+			bulk_p->offsets[keepCnt] = bulk_p->offsets[pos];
+			bulk_p->values[keepCnt++] = bulk_p->values[pos];
+		}
+
+		if (keepCnt < bulk_p->lineCnt) {
+			log_info("BULK[%d] chip: %s releasing %u line(s)\n", b, ctx_p->chipInfo[bulk_p->chipIdx].name,
+					bulk_p->lineCnt - keepCnt);
+			gpio_out_release(bulk_p->req);
+			bulk_p->req = NULL;
+			bulk_p->lineCnt = keepCnt;
+			memset(&bulk_p->values[keepCnt], 0, (GPIO_OUT_MAX - keepCnt) * sizeof(int));
+		}
+		if (keepCnt > 0)
+			ctx_p->bulkInfo[newCnt++] = *bulk_p;
+	}
+	ctx_p->bulkInfoCnt = newCnt;
+
+	for (i=0; i<ctx_p->cfg->gpioInfoCnt; ++i) {
+		gpio_p = &ctx_p->cfg->gpioInfo[i];
+
+		// several names for the same pin share its slot
+		pos = 0;
+		for (b=0; b<ctx_p->bulkInfoCnt; ++b) {
+			if (ctx_p->bulkInfo[b].chipIdx != gpio_p->chipIdx)
+				continue;
+			for (pos=0; pos<ctx_p->bulkInfo[b].lineCnt; ++pos)
+				if (ctx_p->bulkInfo[b].offsets[pos] == (unsigned)gpio_p->pin)
+					break;
+			if (pos < ctx_p->bulkInfo[b].lineCnt)
+				break;
+		}
+		if (b == ctx_p->bulkInfoCnt) {
+			b = get_bulk(ctx_p, i);
+			pos = ctx_p->bulkInfo[b].lineCnt++;
+			ctx_p->bulkInfo[b].offsets[pos] = gpio_p->pin;
+			ctx_p->bulkInfo[b].values[pos] = 0;
+		}
+		gpio_p->bulkIdx = b;
+		gpio_p->bulkPos = pos;
+	}
+
+	log_info("number of gpiochips: %d\n", ctx_p->chipInfoCnt);
+
+	for (b=0; b<ctx_p->bulkInfoCnt; ++b) {
+		bulk_p = &ctx_p->bulkInfo[b];
+		if (bulk_p->req != NULL)
+			continue;
+		log_info("BULK[%d] chip: %s lines: %u\n", b, ctx_p->chipInfo[bulk_p->chipIdx].name, bulk_p->lineCnt);
+
+		bulk_p->req = gpio_out_request(ctx_p->chipInfo[bulk_p->chipIdx].chip, bulk_p->offsets, bulk_p->lineCnt,
+				bulk_p->values, PACKAGE);
+		if (bulk_p->req == NULL) {
+			log_err("can't set configuration for chip %s\n", ctx_p->chipInfo[bulk_p->chipIdx].name);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(bulk_p->written, bulk_p->values, sizeof(bulk_p->written));
+	}
+
+	for (i=0; i<ctx_p->shardCnt; ++i) {
+		shard_p = &ctx_p->shard[i];
+		free(shard_p->dirtyBulk);
+		shard_p->dirtyBulk = (int*)malloc((ctx_p->bulkInfoCnt + 1) * sizeof(int));
+		if (shard_p->dirtyBulk == NULL) {
+			perror("malloc(dirty bulk)");
+			exit(EXIT_FAILURE);
+		}
+		free(shard_p->stateDirty);
+		shard_p->stateDirty = (int*)malloc((ctx_p->cfg->gpioInfoCnt + 1) * sizeof(int));
+		if (shard_p->stateDirty == NULL) {
+			perror("malloc(dirty state)");
+			exit(EXIT_FAILURE);
+		}
+		shard_p->stateDirtyCnt = 0;
+	}
+}
+
+// look up a chip by any name gpio_chip_open() accepts (name, path, number,
+// label), opening it only if no entry refers to the same device yet
+static int
+get_chip (MQTTGPIO_t *ctx_p, const char *chipStr_p)
+{
+	int i, j;
+	GPIOchip_t *chip_p;
+	CHIPinfo_t *chipInfo_p;
+
+	for (i=0; i<ctx_p->chipInfoCnt; ++i)
+		for (j=0; j<ctx_p->chipInfo[i].aliasCnt; ++j)
+			if (strcmp(ctx_p->chipInfo[i].aliases[j], chipStr_p) == 0)
+				return i;
+
+	chip_p = gpio_chip_open(chipStr_p);
+	if (chip_p == NULL) {
+		log_err("can't open gpio device: %s\n", chipStr_p);
+		exit(EXIT_FAILURE);
+	}
+
+	for (i=0; i<ctx_p->chipInfoCnt; ++i)
+		if (strcmp(ctx_p->chipInfo[i].name, gpio_chip_name(chip_p)) == 0)
+			break;
+
+	if (i < ctx_p->chipInfoCnt)
+		gpio_chip_close(chip_p);
+	else {
+		ctx_p->chipInfo = (CHIPinfo_t*)realloc(ctx_p->chipInfo, ((ctx_p->chipInfoCnt+1) * sizeof(CHIPinfo_t)));
+		if (ctx_p->chipInfo == NULL) {
+			perror("realloc(CHIP)");
+			exit(EXIT_FAILURE);
+		}
+		chipInfo_p = &ctx_p->chipInfo[ctx_p->chipInfoCnt];
+		memset(chipInfo_p, 0, sizeof(CHIPinfo_t));
+		chipInfo_p->shard = ctx_p->chipInfoCnt++ % ctx_p->shardCnt;
+		chipInfo_p->chip = chip_p;
+		chipInfo_p->name = strdup(gpio_chip_name(chip_p));
+		if (chipInfo_p->name == NULL) {
+			perror("strdup(chip name)");
+			exit(EXIT_FAILURE);
+		}
+		log_info("opened gpiochip %s (shard %d)\n", chipInfo_p->name, chipInfo_p->shard);
+	}
+
+	chipInfo_p = &ctx_p->chipInfo[i];
+	chipInfo_p->aliases = (char**)realloc(chipInfo_p->aliases, ((chipInfo_p->aliasCnt+1) * sizeof(char*)));
+	if (chipInfo_p->aliases == NULL) {
+		perror("realloc(chip alias)");
+		exit(EXIT_FAILURE);
+	}
+	chipInfo_p->aliases[chipInfo_p->aliasCnt] = strdup(chipStr_p);
+	if (chipInfo_p->aliases[chipInfo_p->aliasCnt] == NULL) {
+		perror("strdup(chip alias)");
+		exit(EXIT_FAILURE);
+	}
+	++chipInfo_p->aliasCnt;
+
+	return i;
+}
+
+// find (or start) a bulk request for this GPIO's chip that still has room
+// and hasn't been made yet
+static int
+get_bulk (MQTTGPIO_t *ctx_p, int gpio)
+{
+	int i;
+	BULKinfo_t *bulk_p;
+
+	for (i=0; i<ctx_p->bulkInfoCnt; ++i) {
+		if ((ctx_p->bulkInfo[i].chipIdx != ctx_p->cfg->gpioInfo[gpio].chipIdx) || (ctx_p->bulkInfo[i].req != NULL))
+			continue;
+		if (ctx_p->bulkInfo[i].lineCnt < GPIO_OUT_MAX)
+			return i;
+	}
+
+	ctx_p->bulkInfo = (BULKinfo_t*)realloc(ctx_p->bulkInfo, ((ctx_p->bulkInfoCnt+1) * sizeof(BULKinfo_t)));
+	if (ctx_p->bulkInfo == NULL) {
+		perror("realloc(BULK)");
+		exit(EXIT_FAILURE);
+	}
+	bulk_p = &ctx_p->bulkInfo[ctx_p->bulkInfoCnt];
+	memset(bulk_p, 0, sizeof(BULKinfo_t));
+	bulk_p->chipIdx = ctx_p->cfg->gpioInfo[gpio].chipIdx;
+
+	return ctx_p->bulkInfoCnt++;
+}
+
+// a reload hands the lines that stay inputs (same chip and pin) over to
+// the new entries, and releases the rest before any outputs are requested;
+// a line the kernel debounces is only kept if its debounce is the same
+static void
+drop_INPUTinfo (MQTTGPIO_t *ctx_p, CONFIG_t *old_p)
+{
+	int i, j;
+	INPUTinfo_t *old_pp, *new_p;
+
+	for (i=0; i<old_p->inputInfoCnt; ++i) {
+		old_pp = &old_p->inputInfo[i];
+		if (old_pp->line == NULL)
+			continue;
+
+		for (j=0; j<ctx_p->cfg->inputInfoCnt; ++j) {
+			new_p = &ctx_p->cfg->inputInfo[j];
+			if ((new_p->line == NULL) && (new_p->pin == old_pp->pin)
+					&& (!old_pp->debounced || (new_p->debounceMs == old_pp->debounceMs))
+					&& (get_chip(ctx_p, new_p->chipStr) == old_pp->chipIdx))
+				break;
+		}
+		if (j < ctx_p->cfg->inputInfoCnt) {
+			new_p->line = old_pp->line;
+			new_p->debounced = old_pp->debounced;
+			new_p->value = old_pp->value;
+			new_p->watch_p = old_pp->watch_p;
+			new_p->watch_p->data_p = new_p;
+			new_p->debounceTimer_p = old_pp->debounceTimer_p;
+			if (new_p->debounceTimer_p != NULL)
+				new_p->debounceTimer_p->data_p = new_p;
+		}
+		else {
+			log_info("releasing input %s\n", old_pp->inputName);
+			loop_del(&ctx_p->mainLoop, old_pp->watch_p);
+			loop_del(&ctx_p->mainLoop, old_pp->debounceTimer_p);
+			gpio_in_release(old_pp->line);
+		}
+		old_pp->line = NULL;
+		old_pp->watch_p = NULL;
+		old_pp->debounceTimer_p = NULL;
+	}
+}
+
+// input lines can't share a request the way outputs do, every line gets
+// its own event fd on the main loop; the debounce timer is only needed if
+// the backend couldn't hand the debounce to the kernel
+static void
+init_INPUTinfo (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	INPUTinfo_t *input_p;
+
+	log_info("number of INPUT items: %d\n", ctx_p->cfg->inputInfoCnt);
+
+	for (i=0; i<ctx_p->cfg->inputInfoCnt; ++i) {
+		input_p = &ctx_p->cfg->inputInfo[i];
+		if (log_on(LOG_INFO)) {
+			log_info("INPUT[%d]\n", i);
+			log_info("\tchip: %s\n", input_p->chipStr);
+			log_info("\tpin: %d\n", input_p->pin);
+			log_info("\tdebounce: %dms\n", input_p->debounceMs);
+		}
+
+		input_p->chipIdx = get_chip(ctx_p, input_p->chipStr);
+
+		// carried over by drop_INPUTinfo(), the debounce may have changed
+		if (input_p->line != NULL) {
+			if ((input_p->debounceMs > 0) && !input_p->debounced && (input_p->debounceTimer_p == NULL))
+				input_p->debounceTimer_p = loop_add_timer(&ctx_p->mainLoop, input_debounce_cb, input_p);
+			if (((input_p->debounceMs <= 0) || input_p->debounced) && (input_p->debounceTimer_p != NULL)) {
+				loop_del(&ctx_p->mainLoop, input_p->debounceTimer_p);
+				input_p->debounceTimer_p = NULL;
+			}
+			continue;
+		}
+
+		if ((input_p->pin < 0) || ((unsigned)input_p->pin >= gpio_chip_lines(ctx_p->chipInfo[input_p->chipIdx].chip))) {
+			log_err("can't get pin: %d\n", input_p->pin);
+			exit(EXIT_FAILURE);
+		}
+
+		input_p->line = gpio_in_request(ctx_p->chipInfo[input_p->chipIdx].chip, input_p->pin, input_p->debounceMs,
+				&input_p->debounced, PACKAGE);
+		if (input_p->line == NULL) {
+			log_err("can't request events for input %s\n", input_p->inputName);
+			exit(EXIT_FAILURE);
+		}
+		input_p->value = gpio_in_value(input_p->line);
+		if (input_p->debounced)
+			log_info("\tdebounced by the kernel\n");
+
+		input_p->watch_p = loop_add(&ctx_p->mainLoop, gpio_in_fd(input_p->line),
+				EPOLLIN, input_event_cb, input_p);
+		if ((input_p->debounceMs > 0) && !input_p->debounced)
+			input_p->debounceTimer_p = loop_add_timer(&ctx_p->mainLoop, input_debounce_cb, input_p);
+	}
+}
+
+// on a reload running children (and queued triggers) stay with the CMD of
+// the same name, so an "OFF" still reaches them, children of CMDs that are
+// gone, or beyond a lowered MAX=, are left running
+static void
+init_CMDinfo (MQTTGPIO_t *ctx_p, CONFIG_t *old_p)
+{
+	int i, j, argc;
+	size_t len;
+	char *token_p;
+	CMDinfo_t *cmd_p, *prev_p;
+
+	log_info("number of CMD items: %d\n", ctx_p->cfg->cmdInfoCnt);
+
+	for (i=0; i<ctx_p->cfg->cmdInfoCnt; ++i) {
+		cmd_p = &ctx_p->cfg->cmdInfo[i];
+		cmd_p->child = (CMDchild_t*)arena_alloc(&ctx_p->cfg->arena, cmd_p->maxChildren * sizeof(CMDchild_t), ARENA_ALIGN);
+
+		// a process changing between plain and PERSISTENT is left to
+		// keep_strays()
+		for (j=0; (old_p != NULL) && (j<old_p->cmdInfoCnt); ++j) {
+			prev_p = &old_p->cmdInfo[j];
+			if ((strcmp(prev_p->actionName, cmd_p->actionName) != 0) || (prev_p->persistent != cmd_p->persistent))
+				continue;
+			cmd_p->childCnt = (prev_p->childCnt < cmd_p->maxChildren)? prev_p->childCnt : cmd_p->maxChildren;
+			memcpy(cmd_p->child, prev_p->child, cmd_p->childCnt * sizeof(CMDchild_t));
+			memmove(prev_p->child, prev_p->child + cmd_p->childCnt, (prev_p->childCnt - cmd_p->childCnt) * sizeof(CMDchild_t));
+			prev_p->childCnt -= cmd_p->childCnt;
+			cmd_p->pending = (prev_p->pending < cmd_p->queueMax)? prev_p->pending : cmd_p->queueMax;
+			if (cmd_p->restart && (prev_p->pending > 0))
+				cmd_p->pending = 1;
+			cmd_p->dropped = prev_p->dropped;
+			cmd_p->helper_p = prev_p->helper_p;
+			if (cmd_p->helper_p != NULL)
+				cmd_p->helper_p->cmd = i;
+			prev_p->helper_p = NULL;
+			break;
+		}
+		ctx_p->cfg->cmdInfo[i].brokerIdx = (ctx_p->cfg->cmdInfo[i].replyTopic == NULL)? -1
+			: resolve_broker(ctx_p->cfg, ctx_p->cfg->cmdInfo[i].brokerName, ctx_p->cfg->cmdInfo[i].replyTopic);
+
+		if (log_on(LOG_INFO)) {
+			log_info("CMD[%d]\n", i);
+			log_info("\taction: %s\n", ctx_p->cfg->cmdInfo[i].actionName);
+			log_info("\tcmd: %s\n", ctx_p->cfg->cmdInfo[i].cmdStr);
+		}
+
+		ctx_p->cfg->cmdInfo[i].valid = false;
+
+		// pre-split the cmd line into an argv[] for posix_spawn(), on a
+		// copy: the interned cmdStr is shared
+		len = strlen(ctx_p->cfg->cmdInfo[i].cmdStr) + 1;
+		ctx_p->cfg->cmdInfo[i].argvBuf = (char*)arena_alloc(&ctx_p->cfg->arena, len, 1);
+		memcpy(ctx_p->cfg->cmdInfo[i].argvBuf, ctx_p->cfg->cmdInfo[i].cmdStr, len);
+		ctx_p->cfg->cmdInfo[i].argv = (char**)arena_alloc(&ctx_p->cfg->arena, (len / 2 + 2) * sizeof(char*), ARENA_ALIGN);
+		argc = 0;
+		for (token_p = strtok(ctx_p->cfg->cmdInfo[i].argvBuf, " \t\n"); token_p != NULL; token_p = strtok(NULL, " \t\n"))
+			ctx_p->cfg->cmdInfo[i].argv[argc++] = token_p;
+		ctx_p->cfg->cmdInfo[i].argv[argc] = NULL;
+		if (argc == 0) {
+			log_err("CMD '%s': nothing to run\n", ctx_p->cfg->cmdInfo[i].actionName);
+			continue;
+		}
+		log_debug("\targs: %d\n", argc - 1);
+
+		if (!cmd_runnable(ctx_p->cfg->cmdInfo[i].actionName, ctx_p->cfg->cmdInfo[i].argv[0]))
+			continue;
+		ctx_p->cfg->cmdInfo[i].valid = true;
+		log_info("\tvalid: %s\n", ctx_p->cfg->cmdInfo[i].valid? "yes" : "no");
+
+		if (ctx_p->cfg->cmdInfo[i].persistent && (ctx_p->cfg->cmdInfo[i].childCnt == 0))
+			start_helper(ctx_p, i);
+	}
+
+	// their sockets are closed, the helpers see the end of their input
+	if (old_p != NULL)
+		for (j=0; j<old_p->cmdInfoCnt; ++j)
+			free_helper(ctx_p, &old_p->cmdInfo[j]);
+}
+
+static void
+init_SUBinfo (MQTTGPIO_t *ctx_p)
+{
+	int i;
+
+	log_info("number of SUB items: %d\n", ctx_p->cfg->subInfoCnt);
+
+	if (ctx_p->cfg->subInfoCnt <= 0)
+		return;
+
+	for (i=0; i<ctx_p->cfg->subInfoCnt; ++i) {
+		if (log_on(LOG_INFO)) {
+			log_info("SUB[%d]\n", i);
+			log_info("\ttopic: %s\n", ctx_p->cfg->subInfo[i].topicStr);
+			log_info("\tgpio: %s\n", ctx_p->cfg->subInfo[i].gpioName);
+			log_info("\tqos: %d\n", ctx_p->cfg->subInfo[i].qos);
+		}
+	}
+}
+
+// on a reload a PUB with the same topic and input keeps its policy state
+static void
+init_PUBinfo (MQTTGPIO_t *ctx_p, CONFIG_t *old_p)
+{
+	int i, j;
+	bool carried;
+	PUBinfo_t *pub_p, *old_pp;
+
+	log_info("number of PUB items: %d\n", ctx_p->cfg->pubInfoCnt);
+
+	for (i=0; i<ctx_p->cfg->pubInfoCnt; ++i) {
+		pub_p = &ctx_p->cfg->pubInfo[i];
+		if (log_on(LOG_INFO)) {
+			log_info("PUB[%d]\n", i);
+			log_info("\ttopic: %s\n", pub_p->topicStr);
+			log_info("\tinput: %s\n", pub_p->inputName);
+			log_info("\tqos: %d\n", pub_p->qos);
+			log_info("\tcoalesce: %dms\n", pub_p->coalesceMs);
+			log_info("\trate: %d/s\n", pub_p->rateMax);
+			log_info("\tcount: %s\n", pub_p->count? "yes" : "no");
+		}
+
+		carried = false;
+		pub_p->lastVal = -1;
+		for (j=0; (old_p != NULL) && (j<old_p->pubInfoCnt); ++j) {
+			old_pp = &old_p->pubInfo[j];
+			if ((old_pp->lastVal == -2) || (strcmp(old_pp->topicStr, pub_p->topicStr) != 0)
+					|| (strcmp(old_pp->inputName, pub_p->inputName) != 0))
+				continue;
+			pub_p->timer_p = old_pp->timer_p;
+			if (pub_p->timer_p != NULL)
+				pub_p->timer_p->data_p = pub_p;
+			pub_p->pending = old_pp->pending;
+			pub_p->pendingVal = old_pp->pendingVal;
+			pub_p->pendingCnt = old_pp->pendingCnt;
+			pub_p->lastVal = old_pp->lastVal;
+			pub_p->windowEnd = old_pp->windowEnd;
+			pub_p->tokens = old_pp->tokens;
+			pub_p->tokensAt = old_pp->tokensAt;
+			carried = (old_pp->rateMax > 0);
+			old_pp->timer_p = NULL;
+			old_pp->lastVal = -2;
+			break;
+		}
+
+		if ((pub_p->coalesceMs > 0) || (pub_p->rateMax > 0)) {
+			if (pub_p->timer_p == NULL)
+				pub_p->timer_p = loop_add_timer(&ctx_p->mainLoop, pub_timer_cb, pub_p);
+		}
+		else if (pub_p->timer_p != NULL) {
+			loop_del(&ctx_p->mainLoop, pub_p->timer_p);
+			pub_p->timer_p = NULL;
+		}
+		if ((pub_p->rateMax > 0) && !carried) {
+			pub_p->tokens = (uint64_t)pub_p->rateMax * 1000;
+			pub_p->tokensAt = now_ms();
+		}
+		if (pub_p->pending)
+			pub_try(ctx_p, pub_p);
+	}
+
+	for (j=0; (old_p != NULL) && (j<old_p->pubInfoCnt); ++j) {
+		loop_del(&ctx_p->mainLoop, old_p->pubInfo[j].timer_p);
+		old_p->pubInfo[j].timer_p = NULL;
+	}
+}
+
+// resolve each SUB's name to the GPIO and CMD entries it drives (and each
+// SCENE's to its GPIOs) and build a hash of the unique topics so
+// process_message() doesn't have to scan
+static void
+init_dispatch (MQTTGPIO_t *ctx_p)
+{
+	int i, j, topicCnt;
+	uint32_t hashSize, slot;
+
+	for (i=0; i<ctx_p->cfg->gpioInfoCnt; ++i)
+		ctx_p->cfg->gpioInfo[i].brokerIdx = (ctx_p->cfg->gpioInfo[i].stateTopic == NULL)? -1
+			: resolve_broker(ctx_p->cfg, ctx_p->cfg->gpioInfo[i].brokerName, ctx_p->cfg->gpioInfo[i].stateTopic);
+	for (i=0; i<ctx_p->cfg->pubInfoCnt; ++i)
+		ctx_p->cfg->pubInfo[i].brokerIdx = resolve_broker(ctx_p->cfg, ctx_p->cfg->pubInfo[i].brokerName, ctx_p->cfg->pubInfo[i].topicStr);
+	ctx_p->cfg->statsBrokerIdx = (ctx_p->cfg->statsTopic == NULL)? -1 : resolve_broker(ctx_p->cfg, ctx_p->cfg->statsBrokerName, ctx_p->cfg->statsTopic);
+
+	for (i=0; i<ctx_p->cfg->subInfoCnt; ++i) {
+		ctx_p->cfg->subInfo[i].brokerIdx = resolve_broker(ctx_p->cfg, ctx_p->cfg->subInfo[i].brokerName, ctx_p->cfg->subInfo[i].topicStr);
+		// interned, the same name is the same pointer
+		for (j=0; j<ctx_p->cfg->gpioInfoCnt; ++j)
+			if (ctx_p->cfg->subInfo[i].gpioName == ctx_p->cfg->gpioInfo[j].gpioName)
+				ctx_p->cfg->subInfo[i].gpioIdx = append_idx(ctx_p->cfg->subInfo[i].gpioIdx, &ctx_p->cfg->subInfo[i].gpioIdxCnt, j);
+		for (j=0; j<ctx_p->cfg->cmdInfoCnt; ++j)
+			if (ctx_p->cfg->subInfo[i].gpioName == ctx_p->cfg->cmdInfo[j].actionName)
+				ctx_p->cfg->subInfo[i].cmdIdx = append_idx(ctx_p->cfg->subInfo[i].cmdIdx, &ctx_p->cfg->subInfo[i].cmdIdxCnt, j);
+		ctx_p->cfg->subInfo[i].helperCnt = 0;
+		for (j=0; j<ctx_p->cfg->subInfo[i].cmdIdxCnt; ++j)
+			if (ctx_p->cfg->cmdInfo[ctx_p->cfg->subInfo[i].cmdIdx[j]].persistent)
+				++ctx_p->cfg->subInfo[i].helperCnt;
+		ctx_p->cfg->subInfo[i].gpioIdx = (int*)arena_pack(&ctx_p->cfg->arena, ctx_p->cfg->subInfo[i].gpioIdx,
+				ctx_p->cfg->subInfo[i].gpioIdxCnt * sizeof(int));
+		ctx_p->cfg->subInfo[i].cmdIdx = (int*)arena_pack(&ctx_p->cfg->arena, ctx_p->cfg->subInfo[i].cmdIdx,
+				ctx_p->cfg->subInfo[i].cmdIdxCnt * sizeof(int));
+
+		if ((ctx_p->cfg->subInfo[i].gpioIdxCnt == 0) && (ctx_p->cfg->subInfo[i].cmdIdxCnt == 0))
+			log_warning("SUB[%d] '%s': no GPIO or CMD named '%s'\n", i,
+					ctx_p->cfg->subInfo[i].topicStr, ctx_p->cfg->subInfo[i].gpioName);
+		else
+			log_info("SUB[%d] '%s': %d GPIO(s), %d CMD(s)\n", i, ctx_p->cfg->subInfo[i].topicStr,
+					ctx_p->cfg->subInfo[i].gpioIdxCnt, ctx_p->cfg->subInfo[i].cmdIdxCnt);
+	}
+
+	for (i=0; i<ctx_p->cfg->pubInfoCnt; ++i) {
+		if (ctx_p->cfg->pubInfo[i].brokerIdx < 0)
+			continue;
+		for (j=0; j<ctx_p->cfg->inputInfoCnt; ++j)
+			if (ctx_p->cfg->pubInfo[i].inputName == ctx_p->cfg->inputInfo[j].inputName)
+				break;
+		if (j == ctx_p->cfg->inputInfoCnt) {
+			log_warning("PUB[%d] '%s': no INPUT named '%s'\n", i,
+					ctx_p->cfg->pubInfo[i].topicStr, ctx_p->cfg->pubInfo[i].inputName);
+			continue;
+		}
+		ctx_p->cfg->inputInfo[j].pubIdx = append_idx(ctx_p->cfg->inputInfo[j].pubIdx, &ctx_p->cfg->inputInfo[j].pubIdxCnt, i);
+	}
+	for (j=0; j<ctx_p->cfg->inputInfoCnt; ++j)
+		ctx_p->cfg->inputInfo[j].pubIdx = (int*)arena_pack(&ctx_p->cfg->arena, ctx_p->cfg->inputInfo[j].pubIdx,
+				ctx_p->cfg->inputInfo[j].pubIdxCnt * sizeof(int));
+
+	for (i=0; i<ctx_p->cfg->sceneInfoCnt; ++i)
+		init_scene(ctx_p, i);
+
+	topicCnt = ctx_p->cfg->subInfoCnt + ctx_p->cfg->sceneInfoCnt;
+	if (topicCnt <= 0)
+		return;
+
+	// power-of-2 table at most half full, open addressing
+	hashSize = 2;
+	while (hashSize < (uint32_t)topicCnt * 2)
+		hashSize <<= 1;
+	ctx_p->cfg->topicHashMask = hashSize - 1;
+	ctx_p->cfg->topicHash = (int*)arena_alloc(&ctx_p->cfg->arena, hashSize * sizeof(int), ARENA_ALIGN);
+	for (slot=0; slot<hashSize; ++slot)
+		ctx_p->cfg->topicHash[slot] = -1;
+
+	ctx_p->cfg->topicInfo = (TOPICinfo_t*)arena_alloc(&ctx_p->cfg->arena, topicCnt * sizeof(TOPICinfo_t), ARENA_ALIGN);
+
+	for (i=0; i<ctx_p->cfg->subInfoCnt; ++i) {
+		if (ctx_p->cfg->subInfo[i].brokerIdx < 0)
+			continue;
+		j = add_topic(ctx_p, ctx_p->cfg->subInfo[i].brokerIdx, ctx_p->cfg->subInfo[i].topicStr, ctx_p->cfg->subInfo[i].qos);
+		ctx_p->cfg->topicInfo[j].subIdx = append_idx(ctx_p->cfg->topicInfo[j].subIdx, &ctx_p->cfg->topicInfo[j].subIdxCnt, i);
+	}
+	for (i=0; i<ctx_p->cfg->sceneInfoCnt; ++i) {
+		if ((ctx_p->cfg->sceneInfo[i].brokerIdx < 0) || (ctx_p->cfg->sceneInfo[i].gpioIdxCnt == 0))
+			continue;
+		j = add_topic(ctx_p, ctx_p->cfg->sceneInfo[i].brokerIdx, ctx_p->cfg->sceneInfo[i].topicStr, ctx_p->cfg->sceneInfo[i].qos);
+		ctx_p->cfg->topicInfo[j].sceneIdx = append_idx(ctx_p->cfg->topicInfo[j].sceneIdx, &ctx_p->cfg->topicInfo[j].sceneIdxCnt, i);
+	}
+	for (j=0; j<ctx_p->cfg->topicInfoCnt; ++j) {
+		ctx_p->cfg->topicInfo[j].subIdx = (int*)arena_pack(&ctx_p->cfg->arena, ctx_p->cfg->topicInfo[j].subIdx,
+				ctx_p->cfg->topicInfo[j].subIdxCnt * sizeof(int));
+		ctx_p->cfg->topicInfo[j].sceneIdx = (int*)arena_pack(&ctx_p->cfg->arena, ctx_p->cfg->topicInfo[j].sceneIdx,
+				ctx_p->cfg->topicInfo[j].sceneIdxCnt * sizeof(int));
+	}
+
+	log_info("%d unique topic(s) in %u hash slots\n", ctx_p->cfg->topicInfoCnt, hashSize);
+
+	init_trie(ctx_p);
+}
+
+// a scene's GPIOs, and its pattern as a mask and values per bulk request
+// sorted by bulk, so applying it doesn't look at the GPIO table at all;
+// a pin named twice takes the later value
+static void
+init_scene (MQTTGPIO_t *ctx_p, int scene)
+{
+	int i, j, b, had;
+	uint64_t bit;
+	SCENEinfo_t *scene_p = &ctx_p->cfg->sceneInfo[scene];
+	GPIOinfo_t *gpio_p;
+	SCENEbulk_t tmp;
+
+	scene_p->brokerIdx = resolve_broker(ctx_p->cfg, scene_p->brokerName, scene_p->topicStr);
+	for (i=0; i<scene_p->setCnt; ++i) {
+		had = scene_p->gpioIdxCnt;
+
+		// interned, the same name is the same pointer
+		for (j=0; j<ctx_p->cfg->gpioInfoCnt; ++j) {
+			gpio_p = &ctx_p->cfg->gpioInfo[j];
+			if (scene_p->set[i].gpioName != gpio_p->gpioName)
+				continue;
+			scene_p->gpioIdx = append_idx(scene_p->gpioIdx, &scene_p->gpioIdxCnt, j);
+
+			for (b=0; b<scene_p->bulkCnt; ++b)
+				if (scene_p->bulk[b].bulkIdx == gpio_p->bulkIdx)
+					break;
+			if (b == scene_p->bulkCnt) {
+				scene_p->bulk = (SCENEbulk_t*)grow_table(scene_p->bulk, scene_p->bulkCnt, sizeof(SCENEbulk_t), "SCENE bulk");
+				memset(&scene_p->bulk[b], 0, sizeof(SCENEbulk_t));
+				scene_p->bulk[b].bulkIdx = gpio_p->bulkIdx;
+				++scene_p->bulkCnt;
+			}
+			bit = (uint64_t)1 << gpio_p->bulkPos;
+			scene_p->bulk[b].mask |= bit;
+			if (scene_p->set[i].val)
+				scene_p->bulk[b].bits |= bit;
+			else
+				scene_p->bulk[b].bits &= ~bit;
+		}
+		if (scene_p->gpioIdxCnt == had)
+			log_warning("SCENE[%d] '%s' %s: no GPIO named '%s'\n", scene, scene_p->topicStr, scene_p->payload, scene_p->set[i].gpioName);
+	}
+
+	// a handful of bulks at most
+	for (i=1; i<scene_p->bulkCnt; ++i) {
+		tmp = scene_p->bulk[i];
+		for (j=i; (j > 0) && (scene_p->bulk[j-1].bulkIdx > tmp.bulkIdx); --j)
+			scene_p->bulk[j] = scene_p->bulk[j-1];
+		scene_p->bulk[j] = tmp;
+	}
+
+	scene_p->gpioIdx = (int*)arena_pack(&ctx_p->cfg->arena, scene_p->gpioIdx, scene_p->gpioIdxCnt * sizeof(int));
+	scene_p->bulk = (SCENEbulk_t*)arena_pack(&ctx_p->cfg->arena, scene_p->bulk, scene_p->bulkCnt * sizeof(SCENEbulk_t));
+	log_info("SCENE[%d] '%s' %s: %d GPIO(s), %d bulk write(s)\n", scene, scene_p->topicStr, scene_p->payload,
+			scene_p->gpioIdxCnt, scene_p->bulkCnt);
+}
+
+// the topic's entry, a new one if it's the first SUB/SCENE on it
+static int
+add_topic (MQTTGPIO_t *ctx_p, int brokerIdx, const char *topicStr_p, int qos)
+{
+	int j;
+	uint32_t slot;
+
+	j = lookup_topic(ctx_p->cfg, brokerIdx, topicStr_p);
+	if (j < 0) {
+		j = ctx_p->cfg->topicInfoCnt++;
+		ctx_p->cfg->topicInfo[j].topicStr = topicStr_p;
+		ctx_p->cfg->topicInfo[j].brokerIdx = brokerIdx;
+		ctx_p->cfg->topicInfo[j].qos = qos;
+		ctx_p->cfg->topicInfo[j].hash = hash_str(topicStr_p) ^ (uint32_t)brokerIdx;
+		slot = ctx_p->cfg->topicInfo[j].hash & ctx_p->cfg->topicHashMask;
+		while (ctx_p->cfg->topicHash[slot] != -1)
+			slot = (slot + 1) & ctx_p->cfg->topicHashMask;
+		ctx_p->cfg->topicHash[slot] = j;
+	}
+	if (qos > ctx_p->cfg->topicInfo[j].qos)
+		ctx_p->cfg->topicInfo[j].qos = qos;
+	return j;
+}
+
+int
+find_broker (const CONFIG_t *cfg_p, const char *name_p)
+{
+	int i;
+
+	for (i=0; i<cfg_p->brokerInfoCnt; ++i)
+		if (strcmp(cfg_p->brokerInfo[i].brokerName, name_p) == 0)
+			return i;
+	return -1;
+}
+
+// no BROKER= means the MQTT line's broker, or the first BROKER if there's
+// no MQTT line
+int
+resolve_broker (const CONFIG_t *cfg_p, const char *name_p, const char *what_p)
+{
+	int idx;
+
+	if (name_p == NULL) {
+		idx = find_broker(cfg_p, DEFAULT_BROKER_NAME);
+		if ((idx < 0) && (cfg_p->brokerInfoCnt > 0))
+			idx = 0;
+	}
+	else
+		idx = find_broker(cfg_p, name_p);
+
+	if (idx < 0)
+		log_warning("'%s': no broker named '%s', ignored\n", what_p, (name_p != NULL)? name_p : DEFAULT_BROKER_NAME);
+	return idx;
+}
+
+static void
+init_trie (MQTTGPIO_t *ctx_p)
+{
+	int i, node, levelCnt;
+	uint32_t edgeSize, slot;
+	const char *level_p, *end_p;
+	size_t len;
+
+	if (ctx_p->cfg->brokerInfoCnt == 0)
+		return;
+
+	// one root per broker, a filter with n levels adds at most n nodes
+	// and n edges
+	levelCnt = ctx_p->cfg->brokerInfoCnt;
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		++levelCnt;
+		for (level_p = ctx_p->cfg->topicInfo[i].topicStr; *level_p != 0; ++level_p)
+			if (*level_p == '/')
+				++levelCnt;
+	}
+
+	ctx_p->cfg->trieNode = (TRIEnode_t*)arena_alloc(&ctx_p->cfg->arena, levelCnt * sizeof(TRIEnode_t), ARENA_ALIGN);
+	ctx_p->cfg->matchBuf = (int*)arena_alloc(&ctx_p->cfg->arena, (ctx_p->cfg->topicInfoCnt + 1) * sizeof(int), ARENA_ALIGN);
+	for (i=0; i<ctx_p->shardCnt; ++i)
+		ctx_p->shard[i].matchBuf = (int*)arena_alloc(&ctx_p->cfg->arena, (ctx_p->cfg->topicInfoCnt + 1) * sizeof(int),
+				ARENA_ALIGN);
+	edgeSize = 2;
+	while (edgeSize < (uint32_t)levelCnt * 2)
+		edgeSize <<= 1;
+	ctx_p->cfg->trieEdgeMask = edgeSize - 1;
+	ctx_p->cfg->trieEdge = (TRIEedge_t*)arena_alloc(&ctx_p->cfg->arena, edgeSize * sizeof(TRIEedge_t), ARENA_ALIGN);
+	for (slot=0; slot<edgeSize; ++slot)
+		ctx_p->cfg->trieEdge[slot].child = -1;
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i)
+		ctx_p->cfg->trieNode[i].plusChild = ctx_p->cfg->trieNode[i].hashChild = ctx_p->cfg->trieNode[i].topicIdx = -1;
+	ctx_p->cfg->trieNodeCnt = ctx_p->cfg->brokerInfoCnt;
+
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		node = ctx_p->cfg->topicInfo[i].brokerIdx;
+		for (level_p = ctx_p->cfg->topicInfo[i].topicStr; level_p != NULL; level_p = end_p) {
+			end_p = strchr(level_p, '/');
+			len = (end_p != NULL)? (size_t)(end_p - level_p) : strlen(level_p);
+			if (end_p != NULL)
+				++end_p;
+
+			if ((len == 1) && (level_p[0] == '#')) {
+				if (end_p != NULL) {
+					log_warning("topic '%s': '#' must be the last level\n", ctx_p->cfg->topicInfo[i].topicStr);
+					node = -1;
+					break;
+				}
+				node = trie_child(ctx_p->cfg, node, level_p, len, true);
+			}
+			else if ((len == 1) && (level_p[0] == '+'))
+				node = trie_child(ctx_p->cfg, node, level_p, len, true);
+			else if ((memchr(level_p, '+', len) != NULL) || (memchr(level_p, '#', len) != NULL)) {
+				log_warning("topic '%s': wildcards must fill a whole level\n", ctx_p->cfg->topicInfo[i].topicStr);
+				node = -1;
+				break;
+			}
+			else
+				node = trie_child(ctx_p->cfg, node, level_p, len, true);
+		}
+		if (node >= 0)
+			ctx_p->cfg->trieNode[node].topicIdx = i;
+	}
+
+	log_info("topic trie: %d node(s) in %u edge slots\n", ctx_p->cfg->trieNodeCnt, edgeSize);
+}
+
+// subscribe to what's new (or changed qos), unsubscribe from what's gone,
+// a disconnected broker will subscribe to everything once it's back (a
+// persistent session keeps the removed ones, their messages match nothing)
+static void
+update_subscriptions (MQTTGPIO_t *ctx_p, const CONFIG_t *old_p)
+{
+	int i, j, ret;
+	BROKERinfo_t *broker_p;
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i)
+		if (!ctx_p->cfg->brokerInfo[i].connected)
+			ctx_p->cfg->brokerInfo[i].resubscribe = true;
+
+	for (i=0; i<old_p->topicInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[old_p->topicInfo[i].brokerIdx];
+		if (!broker_p->connected)
+			continue;
+		if (lookup_topic(ctx_p->cfg, old_p->topicInfo[i].brokerIdx, old_p->topicInfo[i].topicStr) >= 0)
+			continue;
+		ret = mosquitto_unsubscribe(broker_p->mosq, NULL, old_p->topicInfo[i].topicStr);
+		if (ret != MOSQ_ERR_SUCCESS)
+			log_err("can't unsubscribe from topic: '%s'\n", old_p->topicInfo[i].topicStr);
+		else
+			log_notice("unsubscribed from topic: '%s'\n", old_p->topicInfo[i].topicStr);
+		broker_wake(broker_p);
+	}
+
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i) {
+		j = lookup_topic(old_p, ctx_p->cfg->topicInfo[i].brokerIdx, ctx_p->cfg->topicInfo[i].topicStr);
+		if (j >= 0)
+			memcpy(&ctx_p->cfg->topicInfo[i].hist, &old_p->topicInfo[j].hist, sizeof(HIST_t));
+
+		broker_p = &ctx_p->cfg->brokerInfo[ctx_p->cfg->topicInfo[i].brokerIdx];
+		if (!broker_p->connected)
+			continue;
+		if ((j >= 0) && (old_p->topicInfo[j].qos == ctx_p->cfg->topicInfo[i].qos))
+			continue;
+		ret = mosquitto_subscribe(broker_p->mosq, NULL, ctx_p->cfg->topicInfo[i].topicStr, ctx_p->cfg->topicInfo[i].qos);
+		if (ret != MOSQ_ERR_SUCCESS)
+			log_err("can't subscribe to topic: '%s'\n", ctx_p->cfg->topicInfo[i].topicStr);
+		else
+			log_notice("subscribed to topic: '%s'\n", ctx_p->cfg->topicInfo[i].topicStr);
+		broker_wake(broker_p);
+	}
+}
+
+// the broker table is created once, a reload has to describe the same one
+static bool
+same_brokers (const CONFIG_t *a_p, const CONFIG_t *b_p)
+{
+	int i;
+	const BROKERinfo_t *x_p, *y_p;
+
+	if (a_p->brokerInfoCnt != b_p->brokerInfoCnt)
+		return false;
+	for (i=0; i<a_p->brokerInfoCnt; ++i) {
+		x_p = &a_p->brokerInfo[i];
+		y_p = &b_p->brokerInfo[i];
+		if ((strcmp(x_p->brokerName, y_p->brokerName) != 0) || (strcmp(x_p->server, y_p->server) != 0)
+				|| (x_p->port != y_p->port) || ((x_p->clientId == NULL) != (y_p->clientId == NULL))
+				|| ((x_p->clientId != NULL) && (strcmp(x_p->clientId, y_p->clientId) != 0)))
+			return false;
+	}
+	return true;
+}
+
+// SIGHUP: parse the config file into a new table set, make it live and
+// carry over whatever is unchanged, a config with errors changes nothing
+static void
+reload_config (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	CONFIG_t *new_p, *old_p;
+
+	log_notice("reloading %s\n", ctx_p->configFile);
+
+	new_p = (CONFIG_t*)calloc(1, sizeof(CONFIG_t));
+	if (new_p == NULL) {
+		perror("calloc(config)");
+		return;
+	}
+	if (!read_config(ctx_p->configFile, new_p)) {
+		log_warning("config has errors, keeping the running one\n");
+		free_config(new_p);
+		return;
+	}
+
+	// the broker connections (and their threads) stay as they are
+	if (!same_brokers(new_p, ctx_p->cfg))
+		log_warning("MQTT/BROKER changes need a restart, ignored\n");
+	if (!ctx_p->rtSet && ((new_p->rtPrio != ctx_p->cfg->rtPrio) || (new_p->rtCpu != ctx_p->cfg->rtCpu)))
+		log_warning("REALTIME changes need a restart, ignored\n");
+	if (new_p->shardCnt != ctx_p->cfg->shardCnt)
+		log_warning("SHARDS changes need a restart, ignored\n");
+	new_p->shardCnt = ctx_p->cfg->shardCnt;
+
+	// the tables are rebuilt under the shards, they pick up where they
+	// left off on the rings once it's done
+	stop_shards(ctx_p);
+	free_brokers(new_p);
+	new_p->brokerInfo = ctx_p->cfg->brokerInfo;
+	new_p->brokerInfoCnt = ctx_p->cfg->brokerInfoCnt;
+	ctx_p->cfg->brokerInfo = NULL;
+	ctx_p->cfg->brokerInfoCnt = 0;
+
+	old_p = ctx_p->cfg;
+	ctx_p->cfg = new_p;
+
+	drop_INPUTinfo(ctx_p, old_p);
+	init_GPIOinfo(ctx_p);
+	carry_reverts(ctx_p, old_p);
+	init_INPUTinfo(ctx_p);
+	init_CMDinfo(ctx_p, old_p);
+	init_SUBinfo(ctx_p);
+	init_PUBinfo(ctx_p, old_p);
+	init_dispatch(ctx_p);
+	update_subscriptions(ctx_p, old_p);
+	arm_cmd_timer(ctx_p);
+	arm_stats_timer(ctx_p);
+	metrics_open(ctx_p);
+	for (i=0; i<ctx_p->cfg->gpioInfoCnt; ++i)
+		publish_state(ctx_p, i);
+	keep_strays(ctx_p, old_p);
+
+	free_config(old_p);
+	start_shards(ctx_p);
+	log_notice("reload done\n");
+}
+
+// the processes of CMDs the new config dropped run on, supervise_cmds()
+// still has to reap them
+static void
+keep_strays (MQTTGPIO_t *ctx_p, CONFIG_t *old_p)
+{
+	int i;
+	pid_t *new_p;
+	CMDinfo_t *cmd_p;
+
+	for (i=0; i<old_p->cmdInfoCnt; ++i) {
+		cmd_p = &old_p->cmdInfo[i];
+		while (cmd_p->childCnt > 0) {
+			new_p = (pid_t*)realloc(ctx_p->strayPid, (ctx_p->strayPidCnt + 1) * sizeof(pid_t));
+			if (new_p == NULL) {
+				perror("realloc(stray pids)");
+				return;
+			}
+			ctx_p->strayPid = new_p;
+			ctx_p->strayPid[ctx_p->strayPidCnt++] = cmd_p->child[--cmd_p->childCnt].pid;
+		}
+	}
+}
+
+// memory only, the lines, watches and children are dealt with by whoever
+// owns them at the time
+static void
+free_config (CONFIG_t *cfg_p)
+{
+	if (cfg_p == NULL)
+		return;
+
+	free_brokers(cfg_p);
+	arena_free(&cfg_p->arena);
+	free(cfg_p);
+}
+
+// the config half of the broker table, stop_brokers() does the rest
+void
+free_brokers (CONFIG_t *cfg_p)
+{
+	int i;
+
+	for (i=cfg_p->brokerInfoCnt-1; i>=0; --i) {
+		free(cfg_p->brokerInfo[i].brokerName);
+		free(cfg_p->brokerInfo[i].server);
+		free(cfg_p->brokerInfo[i].clientId);
+	}
+	free(cfg_p->brokerInfo);
+	cfg_p->brokerInfo = NULL;
+	cfg_p->brokerInfoCnt = 0;
+}
+
+// what a broker's thread and the readers of its messages share
+static void
+init_ring (MQTTGPIO_t *ctx_p, int brokerIdx)
+{
+	BROKERinfo_t *broker_p = &ctx_p->cfg->brokerInfo[brokerIdx];
+
+	broker_p->brokerIdx = brokerIdx;
+	broker_p->ctx_p = ctx_p;
+	broker_p->ring.buf = (unsigned char*)malloc(ACTION_RING_SIZE);
+	if (broker_p->ring.buf == NULL) {
+		perror("malloc(action ring)");
+		exit(EXIT_FAILURE);
+	}
+	broker_p->ring.mask = ACTION_RING_SIZE - 1;
+}
+
+static void
+init_mosquitto (MQTTGPIO_t *ctx_p)
+{
+	int i, fd, ret;
+	sigset_t all, old;
+	BROKERinfo_t *broker_p;
+
+	if (ctx_p->cfg->brokerInfoCnt == 0) {
+		log_err("no MQTT broker configured\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (atomic_fetch_add(&mosqUsers_G, 1) == 0) {
+		ret = mosquitto_lib_init();
+		if (ret != MOSQ_ERR_SUCCESS) {
+			log_err("can't initialize mosquitto library\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	ctx_p->mosqInit = true;
+
+	// several daemons restarted together shouldn't retry in lockstep
+	srandom((unsigned)time(NULL) ^ (unsigned)getpid());
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		init_ring(ctx_p, i);
+		broker_p->reconnectSec = 1;
+
+		// with a client ID the broker keeps our subscriptions (and queues
+		// qos>0 messages) while we're away
+		broker_p->mosq = mosquitto_new(broker_p->clientId, broker_p->clientId == NULL, broker_p);
+		if (broker_p->mosq == NULL) {
+			perror("mosquitto_new()");
+			exit(EXIT_FAILURE);
+		}
+
+		// other threads only queue packets, this broker's thread writes
+		// them once broker_wake() tells it to look
+		mosquitto_threaded_set(broker_p->mosq, true);
+		mosquitto_connect_with_flags_callback_set(broker_p->mosq, connect_callback);
+		mosquitto_message_callback_set(broker_p->mosq, process_message);
+
+		broker_p->loop.ctx_p = ctx_p;
+		broker_p->loop.epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (broker_p->loop.epollFd < 0) {
+			perror("epoll_create1()");
+			exit(EXIT_FAILURE);
+		}
+		fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd < 0) {
+			perror("eventfd()");
+			exit(EXIT_FAILURE);
+		}
+		broker_p->wakeWatch_p = loop_add(&broker_p->loop, fd, EPOLLIN, broker_wake_cb, broker_p);
+		broker_p->miscTimer_p = loop_add_timer(&broker_p->loop, mqtt_misc_cb, broker_p);
+		broker_p->reconnectTimer_p = loop_add_timer(&broker_p->loop, mqtt_reconnect_cb, broker_p);
+		broker_p->loop.post = mqtt_post_cb;
+		broker_p->loop.postData_p = broker_p;
+
+		// signals belong to whoever runs the main loop
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		ret = pthread_create(&broker_p->thread, NULL, broker_thread, broker_p);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		if (ret != 0) {
+			log_err("can't start thread for broker '%s': %s\n", broker_p->brokerName, strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+		broker_p->threadStarted = true;
+	}
+}
+
+// called at the end of mqttgpio_start(): the tables, rings and broker
+// threads exist by then, so locking memory now covers everything the
+// dispatch touches; freed memory stays in the heap instead of going back
+// to the kernel (and faulting in again); the loop thread (GPIO writes,
+// CMDs, timers) goes SCHED_FIFO, optionally pinned, while the broker
+// threads (network) and the log thread stay as they were; the shard
+// threads start after it with the same policy, on any CPU; children
+// don't inherit the policy, they do inherit the CPU
+static void
+realtime_start (MQTTGPIO_t *ctx_p)
+{
+	int prio, cpu, ret;
+	cpu_set_t cpus;
+	struct sched_param param;
+
+	prio = ctx_p->rtSet? ctx_p->rtPrio : ctx_p->cfg->rtPrio;
+	cpu = ctx_p->rtSet? ctx_p->rtCpu : ctx_p->cfg->rtCpu;
+	if (prio <= 0)
+		return;
+
+#ifdef M_TRIM_THRESHOLD
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		log_warning("real-time: can't lock memory: %s\n", strerror(errno));
+	prefault_stack();
+
+	if (cpu >= 0) {
+		if ((sched_getaffinity(0, sizeof(cpus), &cpus) != 0) || (cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &cpus))
+			log_warning("real-time: cpu %d isn't available, not pinned\n", cpu);
+		else {
+			CPU_ZERO(&cpus);
+			CPU_SET(cpu, &cpus);
+			ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+			if (ret != 0)
+				log_warning("real-time: can't pin to cpu %d: %s\n", cpu, strerror(ret));
+		}
+	}
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0) {
+		log_warning("real-time: can't set SCHED_FIFO %d: %s\n", prio, strerror(errno));
+		return;
+	}
+	ctx_p->rtActive = true;
+	ctx_p->rtActivePrio = prio;
+	if (cpu >= 0)
+		log_notice("real-time: SCHED_FIFO %d on cpu %d\n", prio, cpu);
+	else
+		log_notice("real-time: SCHED_FIFO %d\n", prio);
+}
+
+// touch the stack the loop will need so its pages are there (and locked)
+// before the first message
+static void
+prefault_stack (void)
+{
+	volatile char stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	for (i=0; i<sizeof(stack); i+=4096)
+		stack[i] = 0;
+}
+
+// the first connect blocks (DNS, TCP), so it's made here rather than in
+// init_mosquitto(); a failure is retried like any other lost connection,
+// mosquitto_connect() has recorded the broker by then
+static void *
+broker_thread (void *data_p)
+{
+	int ret;
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)data_p;
+
+	ret = mosquitto_connect(broker_p->mosq, broker_p->server, broker_p->port, 10);
+	if (ret != MOSQ_ERR_SUCCESS)
+		mqtt_lost(broker_p, ret);
+	else
+		mqtt_attach(broker_p);
+
+	loop_run(&broker_p->loop);
+	return NULL;
+}
+
+// another thread queued something for this broker, or wants it to quit
+void
+broker_wake (BROKERinfo_t *broker_p)
+{
+	uint64_t one = 1;
+
+	if (broker_p->wakeWatch_p != NULL)
+		if (write(broker_p->wakeWatch_p->fd, &one, sizeof(one)) != sizeof(one))
+			perror("write(wake)");
+}
+
+// nothing to do but drain, mqtt_post_cb() runs after this
+static void
+broker_wake_cb (NOTU MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	uint64_t cnt;
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)data_p;
+
+	while (read(broker_p->wakeWatch_p->fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+		;
+}
+
+// stop and join the broker threads before anything they use goes away
+static void
+stop_brokers (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	BROKERinfo_t *broker_p;
+
+	if (ctx_p->cfg == NULL)
+		return;
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		if (!broker_p->threadStarted || pthread_equal(broker_p->thread, pthread_self()))
+			continue;
+		broker_p->loop.quit = true;
+		broker_wake(broker_p);
+		pthread_join(broker_p->thread, NULL);
+		broker_p->threadStarted = false;
+	}
+
+	for (i=0; i<ctx_p->cfg->brokerInfoCnt; ++i) {
+		broker_p = &ctx_p->cfg->brokerInfo[i];
+		if (broker_p->threadStarted)
+			continue;
+		if (broker_p->mosq != NULL) {
+			mosquitto_destroy(broker_p->mosq);
+			broker_p->mosq = NULL;
+		}
+		free(broker_p->ring.buf);
+		broker_p->ring.buf = NULL;
+		if (broker_p->loop.epollFd >= 0) {
+			loop_del(&broker_p->loop, broker_p->watch_p);
+			loop_del(&broker_p->loop, broker_p->miscTimer_p);
+			loop_del(&broker_p->loop, broker_p->reconnectTimer_p);
+			if (broker_p->wakeWatch_p != NULL) {
+				close(broker_p->wakeWatch_p->fd);
+				loop_del(&broker_p->loop, broker_p->wakeWatch_p);
+				broker_p->wakeWatch_p = NULL;
+			}
+			loop_close(&broker_p->loop);
+		}
+	}
+}
+
+// signals are left to the program, mqttgpio_watch_signals() adds them
+// to this loop
+static void
+init_mainloop (MQTTGPIO_t *ctx_p)
+{
+	int fd;
+
+	ctx_p->mainLoop.ctx_p = ctx_p;
+	ctx_p->mainLoop.epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (ctx_p->mainLoop.epollFd < 0) {
+		perror("epoll_create1()");
+		exit(EXIT_FAILURE);
+	}
+
+	// the broker threads kick this when they've queued actions
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		perror("eventfd()");
+		exit(EXIT_FAILURE);
+	}
+	ctx_p->actionWatch_p = loop_add(&ctx_p->mainLoop, fd, EPOLLIN, action_cb, NULL);
+
+	ctx_p->cmdTimer_p = loop_add_timer(&ctx_p->mainLoop, cmd_timer_cb, NULL);
+	ctx_p->statsTimer_p = loop_add_timer(&ctx_p->mainLoop, stats_timer_cb, NULL);
+}
+
+static uint64_t
+now_ms (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+uint64_t
+now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+LOOPwatch_t *
+loop_add (LOOP_t *loop_p, int fd, uint32_t events, LOOPcb_t cb, void *data_p)
+{
+	LOOPwatch_t *watch_p;
+	struct epoll_event ev;
+
+	watch_p = (LOOPwatch_t*)calloc(1, sizeof(LOOPwatch_t));
+	if (watch_p == NULL) {
+		perror("calloc(watch)");
+		exit(EXIT_FAILURE);
+	}
+	watch_p->fd = fd;
+	watch_p->cb = cb;
+	watch_p->data_p = data_p;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = watch_p;
+	if (epoll_ctl(loop_p->epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		perror("epoll_ctl(ADD)");
+		exit(EXIT_FAILURE);
+	}
+	return watch_p;
+}
+
+void
+loop_mod (LOOP_t *loop_p, LOOPwatch_t *watch_p, uint32_t events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = watch_p;
+	if (epoll_ctl(loop_p->epollFd, EPOLL_CTL_MOD, watch_p->fd, &ev) != 0)
+		perror("epoll_ctl(MOD)");
+}
+
+// the fd itself belongs to the caller, timers excepted
+void
+loop_del (LOOP_t *loop_p, LOOPwatch_t *watch_p)
+{
+	if (watch_p == NULL)
+		return;
+
+	// the fd may already be closed, epoll will have dropped it then
+	epoll_ctl(loop_p->epollFd, EPOLL_CTL_DEL, watch_p->fd, NULL);
+	if (watch_p->isTimer)
+		close(watch_p->fd);
+	watch_p->fd = -1;
+	watch_p->cb = NULL;
+
+	loop_p->dead = (LOOPwatch_t**)realloc(loop_p->dead, ((loop_p->deadCnt+1) * sizeof(LOOPwatch_t*)));
+	if (loop_p->dead == NULL) {
+		perror("realloc(dead watch)");
+		exit(EXIT_FAILURE);
+	}
+	loop_p->dead[loop_p->deadCnt++] = watch_p;
+}
+
+// frees what loop_del() left behind, the watches must all be gone
+static void
+loop_close (LOOP_t *loop_p)
+{
+	int i;
+
+	for (i=0; i<loop_p->deadCnt; ++i)
+		free(loop_p->dead[i]);
+	free(loop_p->dead);
+	loop_p->dead = NULL;
+	loop_p->deadCnt = 0;
+	close(loop_p->epollFd);
+	loop_p->epollFd = -1;
+}
+
+static LOOPwatch_t *
+loop_add_timer (LOOP_t *loop_p, LOOPcb_t cb, void *data_p)
+{
+	int fd;
+	LOOPwatch_t *watch_p;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		perror("timerfd_create()");
+		exit(EXIT_FAILURE);
+	}
+	watch_p = loop_add(loop_p, fd, EPOLLIN, cb, data_p);
+	watch_p->isTimer = true;
+	return watch_p;
+}
+
+// fire in 'ms' (0 disarms), then every 'intervalMs' if that's non-zero
+void
+loop_arm_timer (LOOPwatch_t *watch_p, uint64_t ms, uint64_t intervalMs)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = (ms % 1000) * 1000000;
+	its.it_interval.tv_sec = intervalMs / 1000;
+	its.it_interval.tv_nsec = (intervalMs % 1000) * 1000000;
+	if (timerfd_settime(watch_p->fd, 0, &its, NULL) != 0)
+		perror("timerfd_settime()");
+}
+
+void
+loop_run (LOOP_t *loop_p)
+{
+	int i, cnt;
+	uint64_t expirations;
+	LOOPwatch_t *watch_p;
+	struct epoll_event events[LOOP_MAX_EVENTS];
+
+	while (!loop_p->quit) {
+		cnt = epoll_wait(loop_p->epollFd, events, LOOP_MAX_EVENTS, -1);
+		if (cnt < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait()");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i=0; i<cnt; ++i) {
+			watch_p = (LOOPwatch_t*)events[i].data.ptr;
+			if (watch_p->cb == NULL)
+				continue;
+			if (watch_p->isTimer)
+				if (read(watch_p->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+					continue;
+			watch_p->cb(loop_p->ctx_p, events[i].events, watch_p->data_p);
+		}
+
+		if (loop_p->post != NULL)
+			loop_p->post(loop_p->ctx_p, 0, loop_p->postData_p);
+
+		for (i=0; i<loop_p->deadCnt; ++i)
+			free(loop_p->dead[i]);
+		loop_p->deadCnt = 0;
+	}
+}
+
+void
+wheel_init (WHEEL_t *wheel_p, LOOP_t *loop_p, void (*fire)(MQTTGPIO_t*, WHEELnode_t*), void (*done)(MQTTGPIO_t*, WHEEL_t*))
+{
+	int i;
+
+	for (i=0; i<WHEEL_SLOTS; ++i)
+		wheel_p->slots[i].prev = wheel_p->slots[i].next = &wheel_p->slots[i];
+	wheel_p->cnt = 0;
+	wheel_p->fire = fire;
+	wheel_p->done = done;
+	wheel_p->timer_p = loop_add_timer(loop_p, wheel_cb, wheel_p);
+}
+
+// (re)schedule, O(1); the timer only ticks while something is scheduled
+void
+wheel_add (WHEEL_t *wheel_p, WHEELnode_t *node_p, uint64_t ms)
+{
+	WHEELnode_t *slot_p;
+
+	wheel_del(wheel_p, node_p);
+	if (wheel_p->cnt == 0) {
+		wheel_p->curTick = now_ms() / WHEEL_TICK_MS;
+		loop_arm_timer(wheel_p->timer_p, WHEEL_TICK_MS, WHEEL_TICK_MS);
+	}
+
+	// round up, never early
+	node_p->expireTick = (now_ms() + ms + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+	if (node_p->expireTick <= wheel_p->curTick)
+		node_p->expireTick = wheel_p->curTick + 1;
+	slot_p = &wheel_p->slots[node_p->expireTick % WHEEL_SLOTS];
+	node_p->next = slot_p;
+	node_p->prev = slot_p->prev;
+	slot_p->prev->next = node_p;
+	slot_p->prev = node_p;
+	++wheel_p->cnt;
+}
+
+// O(1), fine on a node that isn't scheduled
+void
+wheel_del (WHEEL_t *wheel_p, WHEELnode_t *node_p)
+{
+	if (node_p->prev == NULL)
+		return;
+	node_p->prev->next = node_p->next;
+	node_p->next->prev = node_p->prev;
+	node_p->prev = node_p->next = NULL;
+	--wheel_p->cnt;
+}
+
+// visit the slots from the last tick handled up to now (each at most
+// once, however late we are) and fire what's due in them
+static void
+wheel_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	int visits;
+	uint64_t nowTick;
+	WHEELnode_t *slot_p, *node_p, *next_p;
+	WHEEL_t *wheel_p = (WHEEL_t*)data_p;
+
+	nowTick = now_ms() / WHEEL_TICK_MS;
+	for (visits=0; (wheel_p->curTick < nowTick) && (visits < WHEEL_SLOTS); ++visits) {
+		++wheel_p->curTick;
+		slot_p = &wheel_p->slots[wheel_p->curTick % WHEEL_SLOTS];
+		for (node_p = slot_p->next; node_p != slot_p; node_p = next_p) {
+			next_p = node_p->next;
+			if (node_p->expireTick > nowTick)
+				continue;
+			wheel_del(wheel_p, node_p);
+			wheel_p->fire(ctx_p, node_p);
+		}
+	}
+	wheel_p->curTick = nowTick;
+
+	if (wheel_p->done != NULL)
+		wheel_p->done(ctx_p, wheel_p);
+	if (wheel_p->cnt == 0)
+		loop_arm_timer(wheel_p->timer_p, 0, 0);
+}
+
+// a GPIO that keeps its name and line keeps its pending revert, the
+// others are dropped (wheel nodes live in the config tables)
+static void
+carry_reverts (MQTTGPIO_t *ctx_p, CONFIG_t *old_p)
+{
+	int i, j;
+	uint64_t ms, now;
+	GPIOinfo_t *old_pp, *new_pp;
+
+	now = now_ms();
+	for (i=0; i<old_p->gpioInfoCnt; ++i) {
+		old_pp = &old_p->gpioInfo[i];
+		if (old_pp->revert.prev == NULL)
+			continue;
+		ms = (old_pp->revert.expireTick * WHEEL_TICK_MS > now)? old_pp->revert.expireTick * WHEEL_TICK_MS - now : 0;
+		wheel_del(&chip_shard(ctx_p, old_pp->chipIdx)->wheel, &old_pp->revert);
+
+		for (j=0; j<ctx_p->cfg->gpioInfoCnt; ++j) {
+			new_pp = &ctx_p->cfg->gpioInfo[j];
+			if ((strcmp(new_pp->gpioName, old_pp->gpioName) == 0) && (new_pp->chipIdx == old_pp->chipIdx)
+					&& (new_pp->pin == old_pp->pin)) {
+				new_pp->revertVal = old_pp->revertVal;
+				wheel_add(&chip_shard(ctx_p, new_pp->chipIdx)->wheel, &new_pp->revert, ms);
+				break;
+			}
+		}
+	}
+}
+
+static void
+signal_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, NOTU void *data_p)
+{
+	struct signalfd_siginfo info;
+
+	while (read(ctx_p->signalWatch_p->fd, &info, sizeof(info)) == sizeof(info)) {
+		switch (info.ssi_signo) {
+			case SIGCHLD:
+				supervise_cmds(ctx_p);
+				break;
+
+			case SIGHUP:
+				reload_config(ctx_p);
+				break;
+
+			case SIGUSR1:
+				stats_dump(ctx_p);
+				break;
+
+			case SIGTERM:
+			case SIGINT:
+				log_info("caught signal %u, exiting\n", info.ssi_signo);
+				ctx_p->mainLoop.quit = true;
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+// start watching the broker connection broker_thread() (or a reconnect)
+// made, everything from here to mqtt_post_cb() runs on the broker's thread
+static void
+mqtt_attach (BROKERinfo_t *broker_p)
+{
+	int fd;
+
+	fd = mosquitto_socket(broker_p->mosq);
+	if (fd < 0) {
+		mqtt_lost(broker_p, MOSQ_ERR_NO_CONN);
+		return;
+	}
+	broker_p->watch_p = loop_add(&broker_p->loop, fd, EPOLLIN | (mosquitto_want_write(broker_p->mosq)? EPOLLOUT : 0),
+			mqtt_socket_cb, broker_p);
+	loop_arm_timer(broker_p->miscTimer_p, MQTT_MISC_MS, MQTT_MISC_MS);
+}
+
+// 1s..60s exponential backoff, randomly somewhere in the upper half of
+// each step; connect_callback() resets it once the broker accepts us
+static void
+mqtt_lost (BROKERinfo_t *broker_p, int ret)
+{
+	uint64_t delayMs;
+
+	broker_p->connected = false;
+	atomic_fetch_add_explicit(&broker_p->lostCnt, 1, memory_order_relaxed);
+
+	if (broker_p->watch_p != NULL) {
+		loop_del(&broker_p->loop, broker_p->watch_p);
+		broker_p->watch_p = NULL;
+	}
+	loop_arm_timer(broker_p->miscTimer_p, 0, 0);
+
+	delayMs = (uint64_t)broker_p->reconnectSec * 500;
+	delayMs += (uint64_t)random() % (delayMs + 1);
+	log_info("broker '%s' connection: %s, retrying in %lums\n", broker_p->brokerName,
+			mosquitto_strerror(ret), (unsigned long)delayMs);
+	loop_arm_timer(broker_p->reconnectTimer_p, delayMs, 0);
+	if (broker_p->reconnectSec < 60)
+		broker_p->reconnectSec *= 2;
+}
+
+static void
+mqtt_socket_cb (NOTU MQTTGPIO_t *ctx_p, uint32_t events, void *data_p)
+{
+	int ret = MOSQ_ERR_SUCCESS;
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)data_p;
+
+	if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		ret = mosquitto_loop_read(broker_p->mosq, 1);
+	if ((ret == MOSQ_ERR_SUCCESS) && (events & EPOLLOUT))
+		ret = mosquitto_loop_write(broker_p->mosq, 1);
+	if (ret != MOSQ_ERR_SUCCESS)
+		mqtt_lost(broker_p, ret);
+}
+
+// keepalive pings and retries
+static void
+mqtt_misc_cb (NOTU MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	int ret;
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)data_p;
+
+	ret = mosquitto_loop_misc(broker_p->mosq);
+	if ((ret != MOSQ_ERR_SUCCESS) && (broker_p->watch_p != NULL))
+		mqtt_lost(broker_p, ret);
+}
+
+static void
+mqtt_reconnect_cb (NOTU MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	int ret;
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)data_p;
+
+	ret = mosquitto_reconnect(broker_p->mosq);
+	if (ret != MOSQ_ERR_SUCCESS) {
+		mqtt_lost(broker_p, ret);
+		return;
+	}
+	mqtt_attach(broker_p);
+}
+
+// tell the main thread about what this pass queued, only wait for the
+// socket to become writable while libmosquitto has something queued, and
+// notice if it closed the socket on its own
+static void
+mqtt_post_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)data_p;
+
+	ring_notify(ctx_p, broker_p);
+
+	if (broker_p->watch_p == NULL)
+		return;
+	if (mosquitto_socket(broker_p->mosq) != broker_p->watch_p->fd) {
+		mqtt_lost(broker_p, MOSQ_ERR_CONN_LOST);
+		return;
+	}
+	loop_mod(&broker_p->loop, broker_p->watch_p, EPOLLIN | (mosquitto_want_write(broker_p->mosq)? EPOLLOUT : 0));
+}
+
+// one timer for all the kill deadlines, armed to the nearest
+static void
+arm_cmd_timer (MQTTGPIO_t *ctx_p)
+{
+	int i, j;
+	uint64_t now, deadline, next = 0;
+
+	for (i=0; i<ctx_p->cfg->cmdInfoCnt; ++i)
+		for (j=0; j<ctx_p->cfg->cmdInfo[i].childCnt; ++j) {
+			deadline = ctx_p->cfg->cmdInfo[i].child[j].killDeadline;
+			if ((deadline != 0) && (deadline != UINT64_MAX) && ((next == 0) || (deadline < next)))
+				next = deadline;
+		}
+
+	if (next == 0) {
+		loop_arm_timer(ctx_p->cmdTimer_p, 0, 0);
+		return;
+	}
+	now = now_ms();
+	loop_arm_timer(ctx_p->cmdTimer_p, (next > now)? next - now : 1, 0);
+}
+
+static void
+cmd_timer_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, NOTU void *data_p)
+{
+	supervise_cmds(ctx_p);
+}
+
+// kernel events come in batches, without debounce (or with the kernel's)
+// every edge is published, otherwise the line has to sit still for
+// debounceMs after its last edge; a line that's gone (its chip unbound)
+// keeps its fd readable, so it's released rather than read again
+static void
+input_event_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p)
+{
+	int i, cnt;
+	uint64_t now, edgeMs;
+	INPUTinfo_t *input_p = (INPUTinfo_t*)data_p;
+	GPIOedge_t edges[INPUT_EVENT_BATCH];
+
+	cnt = -1;
+	errno = 0;
+	if ((events & (EPOLLERR | EPOLLHUP)) == 0)
+		cnt = gpio_in_read(input_p->line, edges, INPUT_EVENT_BATCH);
+	if ((cnt < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+		return;
+	if (cnt <= 0) {
+		log_err("input %s lost (%s), released\n", input_p->inputName,
+				(errno != 0)? strerror(errno) : "hangup");
+		loop_del(&ctx_p->mainLoop, input_p->watch_p);
+		loop_del(&ctx_p->mainLoop, input_p->debounceTimer_p);
+		gpio_in_release(input_p->line);
+		input_p->line = NULL;
+		input_p->watch_p = NULL;
+		input_p->debounceTimer_p = NULL;
+		return;
+	}
+	log_debug("INPUT %s: %d event(s)\n", input_p->inputName, cnt);
+
+	if ((input_p->debounceMs <= 0) || input_p->debounced) {
+		for (i=0; i<cnt; ++i) {
+			input_p->value = edges[i].rising? 1 : 0;
+			publish_input(ctx_p, input_p - ctx_p->cfg->inputInfo);
+		}
+		return;
+	}
+
+	now = now_ms();
+	edgeMs = edges[cnt-1].tsNs / 1000000;
+	if ((edgeMs > now) || ((now - edgeMs) >= (uint64_t)input_p->debounceMs))
+		edgeMs = now;
+	loop_arm_timer(input_p->debounceTimer_p, input_p->debounceMs - (now - edgeMs) + 1, 0);
+}
+
+// the line has settled, publish its level if that's a change
+static void
+input_debounce_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	int val;
+	INPUTinfo_t *input_p = (INPUTinfo_t*)data_p;
+
+	val = gpio_in_value(input_p->line);
+	if ((val < 0) || (val == input_p->value))
+		return;
+	input_p->value = val;
+	publish_input(ctx_p, input_p - ctx_p->cfg->inputInfo);
+}
+
+static void
+publish_input (MQTTGPIO_t *ctx_p, int input)
+{
+	int i;
+	PUBinfo_t *pub_p;
+
+	for (i=0; i<ctx_p->cfg->inputInfo[input].pubIdxCnt; ++i) {
+		pub_p = &ctx_p->cfg->pubInfo[ctx_p->cfg->inputInfo[input].pubIdx[i]];
+		pub_p->pendingVal = pub_p->inv? !ctx_p->cfg->inputInfo[input].value : ctx_p->cfg->inputInfo[input].value;
+		++pub_p->pendingCnt;
+		pub_p->pending = true;
+		pub_try(ctx_p, pub_p);
+	}
+}
+
+// publish the latest pending value now if the policy allows it, otherwise
+// arm the PUB's timer for when it will
+static void
+pub_try (MQTTGPIO_t *ctx_p, PUBinfo_t *pub_p)
+{
+	int ret;
+	uint64_t now;
+	char payload[24];
+	BROKERinfo_t *broker_p;
+
+	if (!pub_p->pending)
+		return;
+	if (!pub_p->count && (pub_p->pendingVal == pub_p->lastVal)) {
+		pub_p->pending = false;
+		pub_p->pendingCnt = 0;
+		return;
+	}
+
+	now = now_ms();
+	if (pub_p->windowEnd > now) {
+		loop_arm_timer(pub_p->timer_p, pub_p->windowEnd - now, 0);
+		return;
+	}
+
+	// token bucket in thousandths of a message, one second of burst
+	if (pub_p->rateMax > 0) {
+		pub_p->tokens += (now - pub_p->tokensAt) * pub_p->rateMax;
+		if (pub_p->tokens > (uint64_t)pub_p->rateMax * 1000)
+			pub_p->tokens = (uint64_t)pub_p->rateMax * 1000;
+		pub_p->tokensAt = now;
+		if (pub_p->tokens < 1000) {
+			loop_arm_timer(pub_p->timer_p, (1000 - pub_p->tokens + pub_p->rateMax - 1) / pub_p->rateMax, 0);
+			return;
+		}
+		pub_p->tokens -= 1000;
+	}
+
+	if (pub_p->count)
+		snprintf(payload, sizeof(payload), "%lu", pub_p->pendingCnt);
+	else
+		snprintf(payload, sizeof(payload), "%s", pub_p->pendingVal? "ON" : "OFF");
+	log_info("publishing %s to '%s'%s\n", payload, pub_p->topicStr, pub_p->inv? " INV" : "");
+	broker_p = &ctx_p->cfg->brokerInfo[pub_p->brokerIdx];
+	ret = mosquitto_publish(broker_p->mosq, NULL, pub_p->topicStr, strlen(payload), payload, pub_p->qos, false);
+	if (ret != MOSQ_ERR_SUCCESS)
+		log_err("can't publish to '%s': %s\n", pub_p->topicStr, mosquitto_strerror(ret));
+	broker_wake(broker_p);
+
+	pub_p->lastVal = pub_p->pendingVal;
+	pub_p->pendingCnt = 0;
+	pub_p->pending = false;
+	if (pub_p->coalesceMs > 0)
+		pub_p->windowEnd = now + pub_p->coalesceMs;
+}
+
+static void
+pub_timer_cb (MQTTGPIO_t *ctx_p, NOTU uint32_t events, void *data_p)
+{
+	pub_try(ctx_p, (PUBinfo_t*)data_p);
+}
+
+// an "ON": a new child if the CMD and CMDMAX have room, otherwise the
+// CMD's policy says whether the oldest child is restarted, the trigger is
+// queued for when one exits, or dropped
+void
+start_cmd (MQTTGPIO_t *ctx_p, int cmd)
+{
+	int i;
+	CMDinfo_t *cmd_p = &ctx_p->cfg->cmdInfo[cmd];
+
+	if (!cmd_p->valid) {
+		log_warning("CMD '%s' is invalid, not run\n", cmd_p->actionName);
+		return;
+	}
+	if ((cmd_p->childCnt < cmd_p->maxChildren) && (ctx_p->childCnt < ctx_p->cfg->cmdMax)) {
+		spawn_cmd(ctx_p, cmd, NULL);
+		return;
+	}
+
+	if (cmd_p->restart && (cmd_p->childCnt == cmd_p->maxChildren)) {
+		for (i=0; (i<cmd_p->childCnt) && (cmd_p->child[i].killDeadline != 0); ++i)
+			;
+		if (i < cmd_p->childCnt)
+			stop_child(ctx_p, cmd_p, i);
+		cmd_p->pending = 1;
+		return;
+	}
+	if (cmd_p->pending < cmd_p->queueMax) {
+		++cmd_p->pending;
+		log_debug("CMD '%s' is busy, %d trigger(s) queued\n", cmd_p->actionName, cmd_p->pending);
+		return;
+	}
+	++cmd_p->dropped;
+	if ((cmd_p->dropped & (cmd_p->dropped - 1)) == 0)
+		log_warning("CMD '%s' is busy, %lu trigger(s) dropped\n", cmd_p->actionName, cmd_p->dropped);
+}
+
+// queued triggers get the slots that children exiting left, in CMD order
+static void
+run_pending (MQTTGPIO_t *ctx_p)
+{
+	int i;
+	CMDinfo_t *cmd_p;
+
+	for (i=0; i<ctx_p->cfg->cmdInfoCnt; ++i) {
+		cmd_p = &ctx_p->cfg->cmdInfo[i];
+		while ((cmd_p->pending > 0) && (cmd_p->childCnt < cmd_p->maxChildren) && (ctx_p->childCnt < ctx_p->cfg->cmdMax)) {
+			--cmd_p->pending;
+			if (!spawn_cmd(ctx_p, i, NULL))
+				break;
+		}
+	}
+}
+
+// posix_spawn() doesn't copy our page tables and reports exec failures
+// back to us instead of leaving a forked copy of the daemon behind
+static bool
+spawn_cmd (MQTTGPIO_t *ctx_p, int cmd, const posix_spawn_file_actions_t *actions_p)
+{
+	int ret;
+	pid_t pid;
+	uint64_t startNs;
+	sigset_t sigMask;
+	posix_spawnattr_t attr;
+	CMDinfo_t *cmd_p;
+
+	// children start with a clean signal mask and default SIGCHLD
+	posix_spawnattr_init(&attr);
+	sigemptyset(&sigMask);
+	posix_spawnattr_setsigmask(&attr, &sigMask);
+	sigaddset(&sigMask, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &sigMask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	startNs = now_ns();
+	ret = posix_spawn(&pid, ctx_p->cfg->cmdInfo[cmd].argv[0], actions_p, &attr, ctx_p->cfg->cmdInfo[cmd].argv, environ);
+	hist_add(&ctx_p->stageHist[STAT_SPAWN], now_ns() - startNs);
+	posix_spawnattr_destroy(&attr);
+	if (ret != 0) {
+		log_err("can't run '%s': %s\n", ctx_p->cfg->cmdInfo[cmd].cmdStr, strerror(ret));
+		++ctx_p->spawnFailCnt;
+		return false;
+	}
+	++ctx_p->spawnCnt;
+
+	log_info("spawned:'%s' as pid:%u\n", ctx_p->cfg->cmdInfo[cmd].cmdStr, pid);
+	cmd_p = &ctx_p->cfg->cmdInfo[cmd];
+	cmd_p->child[cmd_p->childCnt].pid = pid;
+	cmd_p->child[cmd_p->childCnt].killDeadline = 0;
+	++cmd_p->childCnt;
+	++ctx_p->childCnt;
+	return true;
+}
+
+// a socket rather than pipes: a helper that died is an EPIPE on send()
+// instead of a SIGPIPE for the whole process
+static void
+start_helper (MQTTGPIO_t *ctx_p, int cmd)
+{
+	int sv[2];
+	bool ok;
+	CMDinfo_t *cmd_p = &ctx_p->cfg->cmdInfo[cmd];
+	posix_spawn_file_actions_t actions;
+
+	if (cmd_p->helper_p == NULL) {
+		cmd_p->helper_p = (HELPER_t*)malloc(sizeof(HELPER_t));
+		if (cmd_p->helper_p == NULL) {
+			perror("malloc(helper)");
+			exit(EXIT_FAILURE);
+		}
+		cmd_p->helper_p->fd = -1;
+		cmd_p->helper_p->watch_p = NULL;
+		cmd_p->helper_p->dropped = 0;
+	}
+	cmd_p->helper_p->cmd = cmd;
+	cmd_p->helper_p->outLen = 0;
+	cmd_p->helper_p->replyLen = 0;
+	if (ctx_p->childCnt >= ctx_p->cfg->cmdMax) {
+		log_warning("CMD '%s': CMDMAX processes running, helper not started\n", cmd_p->actionName);
+		return;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+		perror("socketpair(helper)");
+		return;
+	}
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, sv[1], STDIN_FILENO);
+	if (cmd_p->replyTopic != NULL)
+		posix_spawn_file_actions_adddup2(&actions, sv[1], STDOUT_FILENO);
+	ok = spawn_cmd(ctx_p, cmd, &actions);
+	posix_spawn_file_actions_destroy(&actions);
+	close(sv[1]);
+	if (!ok) {
+		close(sv[0]);
+		return;
+	}
+
+	fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+	cmd_p->helper_p->fd = sv[0];
+	cmd_p->helper_p->watch_p = loop_add(&ctx_p->mainLoop, sv[0], EPOLLIN, helper_cb, cmd_p->helper_p);
+}
+
+// one line per message: the topic, a tab, the payload (line breaks in it
+// turned into blanks); queued if the helper is behind, dropped if it's
+// more than HELPER_QUEUE_MAX behind
+void
+helper_send (MQTTGPIO_t *ctx_p, int cmd, const char *topic_p, const char *payload_p, size_t payloadLen)
+{
+	size_t i, topicLen = strlen(topic_p);
+	CMDinfo_t *cmd_p = &ctx_p->cfg->cmdInfo[cmd];
+	HELPER_t *helper_p;
+	char *c_p;
+
+	if (!cmd_p->valid) {
+		log_warning("CMD '%s' is invalid, not run\n", cmd_p->actionName);
+		return;
+	}
+	if (cmd_p->childCnt == 0)
+		start_helper(ctx_p, cmd);
+	helper_p = cmd_p->helper_p;
+	if ((helper_p == NULL) || (helper_p->fd < 0))
+		return;
+
+	if (topicLen + 1 + payloadLen + 1 > HELPER_QUEUE_MAX - helper_p->outLen) {
+		++helper_p->dropped;
+		if ((helper_p->dropped & (helper_p->dropped - 1)) == 0)
+			log_warning("CMD '%s' is behind, %lu message(s) dropped\n", cmd_p->actionName, helper_p->dropped);
+		return;
+	}
+	c_p = helper_p->out + helper_p->outLen;
+	memcpy(c_p, topic_p, topicLen);
+	c_p += topicLen;
+	*c_p++ = '\t';
+	for (i=0; i<payloadLen; ++i)
+		*c_p++ = ((payload_p[i] == '\n') || (payload_p[i] == '\r'))? ' ' : payload_p[i];
+	*c_p++ = '\n';
+	helper_p->outLen = c_p - helper_p->out;
+	helper_flush(ctx_p, helper_p);
+}
+
+static void
+helper_flush (MQTTGPIO_t *ctx_p, HELPER_t *helper_p)
+{
+	ssize_t ret;
+
+	while (helper_p->outLen > 0) {
+		ret = send(helper_p->fd, helper_p->out, helper_p->outLen, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				log_warning("CMD '%s': %s\n", ctx_p->cfg->cmdInfo[helper_p->cmd].actionName, strerror(errno));
+				close_helper(ctx_p, helper_p);
+				return;
+			}
+			break;
+		}
+		memmove(helper_p->out, helper_p->out + ret, helper_p->outLen - ret);
+		helper_p->outLen -= ret;
+	}
+	loop_mod(&ctx_p->mainLoop, helper_p->watch_p, (helper_p->outLen > 0)? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+}
+
+// room for more triggers, or a helper's output, or its end
+static void
+helper_cb (MQTTGPIO_t *ctx_p, uint32_t events, void *data_p)
+{
+	ssize_t ret;
+	char *nl_p;
+	HELPER_t *helper_p = (HELPER_t*)data_p;
+
+	if (events & EPOLLOUT) {
+		helper_flush(ctx_p, helper_p);
+		if (helper_p->fd < 0)
+			return;
+	}
+	if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		return;
+
+	while (1) {
+		ret = read(helper_p->fd, helper_p->reply + helper_p->replyLen, HELPER_REPLY_MAX - helper_p->replyLen);
+		if (ret == 0) {
+			close_helper(ctx_p, helper_p);
+			return;
+		}
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				close_helper(ctx_p, helper_p);
+			return;
+		}
+		helper_p->replyLen += ret;
+
+		// a line is a message, one that fills the buffer goes as it is
+		while ((nl_p = (char*)memchr(helper_p->reply, '\n', helper_p->replyLen)) != NULL) {
+			helper_reply(ctx_p, helper_p, nl_p - helper_p->reply);
+			helper_p->replyLen -= nl_p + 1 - helper_p->reply;
+			memmove(helper_p->reply, nl_p + 1, helper_p->replyLen);
+		}
+		if (helper_p->replyLen == HELPER_REPLY_MAX) {
+			helper_reply(ctx_p, helper_p, helper_p->replyLen);
+			helper_p->replyLen = 0;
+		}
+	}
+}
+
+static void
+helper_reply (MQTTGPIO_t *ctx_p, HELPER_t *helper_p, size_t len)
+{
+	int ret;
+	CMDinfo_t *cmd_p = &ctx_p->cfg->cmdInfo[helper_p->cmd];
+	BROKERinfo_t *broker_p;
+
+	if ((cmd_p->replyTopic == NULL) || (cmd_p->brokerIdx < 0))
+		return;
+	broker_p = &ctx_p->cfg->brokerInfo[cmd_p->brokerIdx];
+	if (!broker_p->connected)
+		return;
+
+	log_info("CMD '%s': publishing %zu byte(s) to '%s'\n", cmd_p->actionName, len, cmd_p->replyTopic);
+	ret = mosquitto_publish(broker_p->mosq, NULL, cmd_p->replyTopic, len, helper_p->reply, 0, false);
+	if (ret != MOSQ_ERR_SUCCESS)
+		log_err("can't publish to '%s': %s\n", cmd_p->replyTopic, mosquitto_strerror(ret));
+	broker_wake(broker_p);
+}
+
+// the process itself is reaped by supervise_cmds()
+static void
+close_helper (MQTTGPIO_t *ctx_p, HELPER_t *helper_p)
+{
+	if (helper_p->fd < 0)
+		return;
+	loop_del(&ctx_p->mainLoop, helper_p->watch_p);
+	close(helper_p->fd);
+	helper_p->fd = -1;
+	helper_p->watch_p = NULL;
+	helper_p->outLen = 0;
+	helper_p->replyLen = 0;
+}
+
+static void
+free_helper (MQTTGPIO_t *ctx_p, CMDinfo_t *cmd_p)
+{
+	if (cmd_p->helper_p == NULL)
+		return;
+	close_helper(ctx_p, cmd_p->helper_p);
+	free(cmd_p->helper_p);
+	cmd_p->helper_p = NULL;
+}
+
+// ask all of a CMD's children to stop, and forget what was queued;
+// supervise_cmds() reaps them and escalates
+void
+stop_cmd (MQTTGPIO_t *ctx_p, int cmd)
+{
+	int i;
+	CMDinfo_t *cmd_p = &ctx_p->cfg->cmdInfo[cmd];
+
+	cmd_p->pending = 0;
+	if (cmd_p->childCnt == 0) {
+		log_info("CMD '%s' isn't running\n", cmd_p->actionName);
+		return;
+	}
+	for (i=0; i<cmd_p->childCnt; ++i)
+		if (cmd_p->child[i].killDeadline == 0)
+			stop_child(ctx_p, cmd_p, i);
+}
+
+static void
+stop_child (MQTTGPIO_t *ctx_p, CMDinfo_t *cmd_p, int child)
+{
+	log_info("terminating pid %u\n", cmd_p->child[child].pid);
+	kill(cmd_p->child[child].pid, SIGTERM);
+	cmd_p->child[child].killDeadline = now_ms() + ctx_p->cfg->cmdGraceMs;
+	arm_cmd_timer(ctx_p);
+}
+
+// a child that's running and hasn't been asked to stop
+bool
+cmd_running (const CMDinfo_t *cmd_p)
+{
+	int i;
+
+	for (i=0; i<cmd_p->childCnt; ++i)
+		if (cmd_p->child[i].killDeadline == 0)
+			return true;
+	return false;
+}
+
+// reap our exited children and SIGKILL the ones that outstayed their
+// grace; only our own pids are waited for, the program we're part of may
+// have children of its own
+static void
+supervise_cmds (MQTTGPIO_t *ctx_p)
+{
+	int i, j, status;
+	pid_t pid;
+	uint64_t now;
+	CMDinfo_t *cmd_p;
+
+	for (i=0; i<ctx_p->cfg->cmdInfoCnt; ++i) {
+		cmd_p = &ctx_p->cfg->cmdInfo[i];
+		for (j=0; j<cmd_p->childCnt; ) {
+			pid = cmd_p->child[j].pid;
+			if (waitpid(pid, &status, WNOHANG) != pid) {
+				++j;
+				continue;
+			}
+			if (log_on(LOG_INFO)) {
+				if (WIFEXITED(status))
+					log_info("CMD '%s' pid %u exited: %d\n", cmd_p->actionName, pid, WEXITSTATUS(status));
+				else if (WIFSIGNALED(status))
+					log_info("CMD '%s' pid %u killed by signal %d\n", cmd_p->actionName, pid, WTERMSIG(status));
+			}
+			memmove(&cmd_p->child[j], &cmd_p->child[j+1], (cmd_p->childCnt - j - 1) * sizeof(CMDchild_t));
+			--cmd_p->childCnt;
+			--ctx_p->childCnt;
+			++ctx_p->reapCnt;
+			if (cmd_p->helper_p != NULL)
+				close_helper(ctx_p, cmd_p->helper_p);
+		}
+	}
+	for (i=ctx_p->strayPidCnt-1; i>=0; --i) {
+		if (waitpid(ctx_p->strayPid[i], &status, WNOHANG) != ctx_p->strayPid[i])
+			continue;
+		ctx_p->strayPid[i] = ctx_p->strayPid[--ctx_p->strayPidCnt];
+		--ctx_p->childCnt;
+		++ctx_p->reapCnt;
+	}
+
+	now = now_ms();
+	for (i=0; i<ctx_p->cfg->cmdInfoCnt; ++i) {
+		cmd_p = &ctx_p->cfg->cmdInfo[i];
+		for (j=0; j<cmd_p->childCnt; ++j) {
+			if ((cmd_p->child[j].killDeadline == 0) || (now < cmd_p->child[j].killDeadline))
+				continue;
+			log_info("CMD '%s' pid %u ignored SIGTERM, sending SIGKILL\n", cmd_p->actionName, cmd_p->child[j].pid);
+			kill(cmd_p->child[j].pid, SIGKILL);
+			cmd_p->child[j].killDeadline = UINT64_MAX;
+		}
+	}
+	run_pending(ctx_p);
+	arm_cmd_timer(ctx_p);
+}
+
+void
+mqttgpio_free (MQTTGPIO_t *ctx_p)
+{
+	int i, j;
+
+	if (ctx_p == NULL)
+		return;
+
+	if (ctx_p->shard != NULL)
+		stop_shards(ctx_p);
+	stop_brokers(ctx_p);
+	if (ctx_p->mosqInit && (atomic_fetch_sub(&mosqUsers_G, 1) == 1))
+		mosquitto_lib_cleanup();
+
+	if (ctx_p->bulkInfoCnt > 0) {
+		for (i=ctx_p->bulkInfoCnt-1; i>=0; --i) {
+			if (ctx_p->bulkInfo[i].req != NULL)
+				gpio_out_release(ctx_p->bulkInfo[i].req);
+		}
+		free(ctx_p->bulkInfo);
+	}
+	if (ctx_p->cfg != NULL) {
+		for (i=ctx_p->cfg->inputInfoCnt-1; i>=0; --i) {
+			loop_del(&ctx_p->mainLoop, ctx_p->cfg->inputInfo[i].watch_p);
+			loop_del(&ctx_p->mainLoop, ctx_p->cfg->inputInfo[i].debounceTimer_p);
+			if (ctx_p->cfg->inputInfo[i].line != NULL)
+				gpio_in_release(ctx_p->cfg->inputInfo[i].line);
+		}
+		for (i=ctx_p->cfg->pubInfoCnt-1; i>=0; --i)
+			loop_del(&ctx_p->mainLoop, ctx_p->cfg->pubInfo[i].timer_p);
+		for (i=ctx_p->cfg->cmdInfoCnt-1; i>=0; --i)
+			free_helper(ctx_p, &ctx_p->cfg->cmdInfo[i]);
+		free_config(ctx_p->cfg);
+	}
+
+	if (ctx_p->chipInfoCnt > 0) {
+		for (i=ctx_p->chipInfoCnt-1; i>=0; --i) {
+			if (ctx_p->chipInfo[i].chip != NULL)
+				gpio_chip_close(ctx_p->chipInfo[i].chip);
+			free(ctx_p->chipInfo[i].name);
+			for (j=0; j<ctx_p->chipInfo[i].aliasCnt; ++j)
+				free(ctx_p->chipInfo[i].aliases[j]);
+			free(ctx_p->chipInfo[i].aliases);
+		}
+		free(ctx_p->chipInfo);
+	}
+
+	for (i=0; (ctx_p->shard != NULL) && (i<ctx_p->shardCnt); ++i) {
+		loop_del(ctx_p->shard[i].loop_p, ctx_p->shard[i].wheel.timer_p);
+		if (ctx_p->shard[i].wakeWatch_p != NULL) {
+			close(ctx_p->shard[i].wakeWatch_p->fd);
+			loop_del(&ctx_p->shard[i].loop, ctx_p->shard[i].wakeWatch_p);
+		}
+		if (ctx_p->shard[i].loop.epollFd >= 0)
+			loop_close(&ctx_p->shard[i].loop);
+		free(ctx_p->shard[i].dirtyBulk);
+		free(ctx_p->shard[i].stateDirty);
+		free(ctx_p->shard[i].batchEnd);
+		free(ctx_p->shard[i].pinRecvNs);
+	}
+	free(ctx_p->shard);
+
+	// last, the tables above may own watches
+	if (ctx_p->mainLoop.epollFd >= 0) {
+		metrics_close(ctx_p);
+		loop_del(&ctx_p->mainLoop, ctx_p->cmdTimer_p);
+		loop_del(&ctx_p->mainLoop, ctx_p->statsTimer_p);
+		if (ctx_p->signalWatch_p != NULL) {
+			close(ctx_p->signalWatch_p->fd);
+			loop_del(&ctx_p->mainLoop, ctx_p->signalWatch_p);
+		}
+		if (ctx_p->actionWatch_p != NULL) {
+			close(ctx_p->actionWatch_p->fd);
+			loop_del(&ctx_p->mainLoop, ctx_p->actionWatch_p);
+		}
+		loop_close(&ctx_p->mainLoop);
+	}
+
+	free(ctx_p->strayPid);
+	free(ctx_p->configFile);
+	free(ctx_p);
+}
+
+static int *
+append_idx (int *idx_p, int *cnt_p, int val)
+{
+	idx_p = (int*)realloc(idx_p, (*cnt_p + 1) * sizeof(int));
+	if (idx_p == NULL) {
+		perror("realloc(idx)");
+		exit(EXIT_FAILURE);
+	}
+	idx_p[(*cnt_p)++] = val;
+	return idx_p;
+}
+
+// a request bigger than a quarter block gets a block of its own, behind
+// the current one so that keeps filling
+void *
+arena_alloc (ARENA_t *arena_p, size_t size, size_t align)
+{
+	size_t pos, blockSize;
+	ARENAblock_t *block_p = arena_p->block_p;
+
+	if (block_p != NULL) {
+		pos = (block_p->used + align - 1) & ~(align - 1);
+		if (pos + size <= block_p->size) {
+			block_p->used = pos + size;
+			return (unsigned char*)block_p->data + pos;
+		}
+	}
+
+	blockSize = (size > ARENA_BLOCK_SIZE / 4)? size : ARENA_BLOCK_SIZE;
+	block_p = (ARENAblock_t*)calloc(1, sizeof(ARENAblock_t) + blockSize);
+	if (block_p == NULL) {
+		perror("calloc(arena)");
+		exit(EXIT_FAILURE);
+	}
+	block_p->size = blockSize;
+	block_p->used = size;
+	if ((blockSize == size) && (arena_p->block_p != NULL)) {
+		block_p->next = arena_p->block_p->next;
+		arena_p->block_p->next = block_p;
+	}
+	else {
+		block_p->next = arena_p->block_p;
+		arena_p->block_p = block_p;
+	}
+	return block_p->data;
+}
+
+// the one copy of this string in the arena, open addressing on hash_str()
+const char *
+arena_intern (ARENA_t *arena_p, const char *str_p)
+{
+	uint32_t i, slot, size;
+	size_t len;
+	const char **strs;
+	char *copy_p;
+
+	if ((arena_p->strs == NULL) || ((arena_p->strCnt + 1) * 2 > arena_p->strMask + 1)) {
+		size = (arena_p->strs == NULL)? 64 : (arena_p->strMask + 1) * 2;
+		strs = (const char**)calloc(size, sizeof(char*));
+		if (strs == NULL) {
+			perror("calloc(intern)");
+			exit(EXIT_FAILURE);
+		}
+		for (i=0; (arena_p->strs != NULL) && (i<=arena_p->strMask); ++i) {
+			if (arena_p->strs[i] == NULL)
+				continue;
+			slot = hash_str(arena_p->strs[i]) & (size - 1);
+			while (strs[slot] != NULL)
+				slot = (slot + 1) & (size - 1);
+			strs[slot] = arena_p->strs[i];
+		}
+		free(arena_p->strs);
+		arena_p->strs = strs;
+		arena_p->strMask = size - 1;
+	}
+
+	slot = hash_str(str_p) & arena_p->strMask;
+	while (arena_p->strs[slot] != NULL) {
+		if (strcmp(arena_p->strs[slot], str_p) == 0)
+			return arena_p->strs[slot];
+		slot = (slot + 1) & arena_p->strMask;
+	}
+	len = strlen(str_p) + 1;
+	copy_p = (char*)arena_alloc(arena_p, len, 1);
+	memcpy(copy_p, str_p, len);
+	arena_p->strs[slot] = copy_p;
+	++arena_p->strCnt;
+	return copy_p;
+}
+
+// move a table built on the heap into the arena
+void *
+arena_pack (ARENA_t *arena_p, void *tab_p, size_t size)
+{
+	void *new_p;
+
+	if (tab_p == NULL)
+		return NULL;
+	new_p = arena_alloc(arena_p, size, ARENA_ALIGN);
+	memcpy(new_p, tab_p, size);
+	free(tab_p);
+	return new_p;
+}
+
+void
+arena_free (ARENA_t *arena_p)
+{
+	ARENAblock_t *block_p;
+
+	while ((block_p = arena_p->block_p) != NULL) {
+		arena_p->block_p = block_p->next;
+		free(block_p);
+	}
+	free(arena_p->strs);
+	memset(arena_p, 0, sizeof(ARENA_t));
+}
+
+// a config table doubles whenever its count reaches a power of two
+void *
+grow_table (void *tab_p, int cnt, size_t elemSize, const char *what_p)
+{
+	if ((cnt & (cnt - 1)) != 0)
+		return tab_p;
+	tab_p = realloc(tab_p, ((cnt == 0)? 1 : (size_t)cnt * 2) * elemSize);
+	if (tab_p == NULL) {
+		log_err("realloc(%s): %s\n", what_p, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return tab_p;
+}
+
+// one SUBSCRIBE packet per qos level in use
+void
+subscribe_all (MQTTGPIO_t *ctx_p, BROKERinfo_t *broker_p)
+{
+	int i, qos, cnt, ret;
+	char **topics;
+
+	if (ctx_p->cfg->topicInfoCnt == 0)
+		return;
+	// libmosquitto's prototype isn't const, it only reads them
+	topics = (char**)malloc(ctx_p->cfg->topicInfoCnt * sizeof(char*));
+	if (topics == NULL) {
+		perror("malloc(topics)");
+		return;
+	}
+
+	// a topic whose qos isn't 0-2 gets no packet below, say so
+	for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i)
+		if ((ctx_p->cfg->topicInfo[i].brokerIdx == broker_p->brokerIdx)
+				&& ((ctx_p->cfg->topicInfo[i].qos < 0) || (ctx_p->cfg->topicInfo[i].qos > 2)))
+			log_warning("not subscribing to '%s' on '%s': qos %d\n", ctx_p->cfg->topicInfo[i].topicStr,
+					broker_p->brokerName, ctx_p->cfg->topicInfo[i].qos);
+
+	for (qos=0; qos<=2; ++qos) {
+		cnt = 0;
+		for (i=0; i<ctx_p->cfg->topicInfoCnt; ++i)
+			if ((ctx_p->cfg->topicInfo[i].brokerIdx == broker_p->brokerIdx) && (ctx_p->cfg->topicInfo[i].qos == qos))
+				topics[cnt++] = (char*)ctx_p->cfg->topicInfo[i].topicStr;
+		if (cnt == 0)
+			continue;
+
+		ret = mosquitto_subscribe_multiple(broker_p->mosq, NULL, cnt, topics, qos, 0, NULL);
+		if (ret != MOSQ_ERR_SUCCESS)
+			log_err("can't subscribe to %d qos %d topic(s) on '%s': %s\n", cnt, qos,
+					broker_p->brokerName, mosquitto_strerror(ret));
+		else
+			log_notice("subscribed to %d qos %d topic(s) on '%s'\n", cnt, qos, broker_p->brokerName);
+	}
+	free(topics);
+	// otherwise the SUBSCRIBEs sit queued until the broker thread's next misc tick
+	broker_wake(broker_p);
+	broker_p->resubscribe = false;
+}
+
+// runs on the broker's thread, the main thread does the (re)subscribing
+static void
+connect_callback (NOTU struct mosquitto *mosq, void *userdata, int result, int flags)
+{
+	BROKERinfo_t *broker_p = (BROKERinfo_t*)userdata;
+
+	if (!result) {
+		log_info("connected to '%s'%s!\n", broker_p->brokerName, (flags & 1)? " (session present)" : "");
+		broker_p->reconnectSec = 1;
+		broker_p->connected = true;
+		atomic_fetch_add_explicit(&broker_p->connectCnt, 1, memory_order_relaxed);
+		if (!ring_push(&broker_p->ring, ACTION_CONNECTED, flags & 1, 0, 0, "", 0, NULL, 0))
+			log_warning("broker '%s': action queue full, connect not handled\n", broker_p->brokerName);
+		broker_p->pushed = true;
+	}
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+#ifndef LIBMQTTGPIO_H
+#define LIBMQTTGPIO_H
+
+#include <stdbool.h>
+
+// an instance: one config file, its pins, CMDs and broker connections, and
+// the loop that drives them; fatal errors (no memory, no gpiochip) still
+// exit the process
+typedef struct MQTTGPIO MQTTGPIO_t;
+
+// the logger is shared by every instance, start it first and stop it
+// after the last mqttgpio_free(); until then records go to stdout
+void mqttgpio_log_start (int verbose, bool useSyslog);
+void mqttgpio_log_stop (void);
+
+// reads the config, NULL if it has errors; <configFile>.img is used
+// instead if mqttgpio_compile_config() made it from the same text
+MQTTGPIO_t *mqttgpio_new (const char *configFile_p);
+
+// validate the config (names resolve, no pin used twice, CMDs runnable)
+// and write <configFile>.img, false if there were problems
+bool mqttgpio_compile_config (const char *configFile_p);
+
+// REALTIME <priority> [CPU=<cpu>] from the command line, it replaces the
+// config's line (a priority of 0 turns it off, a cpu of -1 doesn't pin);
+// call it before mqttgpio_start()
+void mqttgpio_set_realtime (MQTTGPIO_t *ctx_p, int priority, int cpu);
+
+// request the lines and start the broker threads; with REALTIME the
+// calling thread goes SCHED_FIFO, it should be the one that goes on to
+// mqttgpio_run()
+void mqttgpio_start (MQTTGPIO_t *ctx_p);
+
+// returns after mqttgpio_stop() (or a SIGTERM/SIGINT it's watching)
+void mqttgpio_run (MQTTGPIO_t *ctx_p);
+void mqttgpio_stop (MQTTGPIO_t *ctx_p);
+
+// what the signals do, for a program that handles them itself: re-read
+// the config (SIGHUP), log the latency figures (SIGUSR1), reap exited
+// CMDs (SIGCHLD); call them on the thread running mqttgpio_run()
+void mqttgpio_reload (MQTTGPIO_t *ctx_p);
+void mqttgpio_dump_stats (MQTTGPIO_t *ctx_p);
+void mqttgpio_reap (MQTTGPIO_t *ctx_p);
+
+// or let the loop take those signals itself
+void mqttgpio_watch_signals (MQTTGPIO_t *ctx_p);
+
+// stops the broker threads and releases everything, NULL is fine
+void mqttgpio_free (MQTTGPIO_t *ctx_p);
+
+#endif
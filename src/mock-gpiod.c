@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// gpio-backend.h for mqtt-gpio-bench: any chip name opens, lines are plain
+// memory, and a set-values call costs mockWriteNs_G of busy time to stand
+// in for the ioctl
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "gpio-backend.h"
+#include "mock-gpiod.h"
+
+#define MOCK_LINES 1024
+
+struct GPIOchip {
+	char name[32];
+	int values[MOCK_LINES];
+};
+
+struct GPIOout {
+	GPIOchip_t *chip;
+	unsigned cnt;
+	unsigned offsets[GPIO_OUT_MAX];
+};
+
+struct GPIOin {
+	GPIOchip_t *chip;
+	unsigned offset;
+	int eventFd;
+};
+
+const char *gpioBackend_G = "mock";
+
+unsigned long mockWriteNs_G = 0;
+atomic_ulong mockWriteCnt_G = 0;
+atomic_ulong mockLineWriteCnt_G = 0;
+
+static uint64_t
+mock_now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+GPIOchip_t *
+gpio_chip_open (const char *descr_p)
+{
+	GPIOchip_t *chip_p;
+
+	chip_p = (GPIOchip_t*)calloc(1, sizeof(GPIOchip_t));
+	if (chip_p == NULL)
+		return NULL;
+	snprintf(chip_p->name, sizeof(chip_p->name), "%s", descr_p);
+	return chip_p;
+}
+
+const char *
+gpio_chip_name (GPIOchip_t *chip_p)
+{
+	return chip_p->name;
+}
+
+unsigned
+gpio_chip_lines (__attribute__((unused)) GPIOchip_t *chip_p)
+{
+	return MOCK_LINES;
+}
+
+void
+gpio_chip_close (GPIOchip_t *chip_p)
+{
+	free(chip_p);
+}
+
+GPIOout_t *
+gpio_out_request (GPIOchip_t *chip_p, const unsigned *offsets_p, unsigned cnt, const int *vals_p,
+		__attribute__((unused)) const char *consumer_p)
+{
+	unsigned i;
+	GPIOout_t *out_p;
+
+	if (cnt > GPIO_OUT_MAX)
+		return NULL;
+	out_p = (GPIOout_t*)calloc(1, sizeof(GPIOout_t));
+	if (out_p == NULL)
+		return NULL;
+	out_p->chip = chip_p;
+	out_p->cnt = cnt;
+	for (i=0; i<cnt; ++i) {
+		out_p->offsets[i] = offsets_p[i];
+		chip_p->values[offsets_p[i]] = (vals_p != NULL)? vals_p[i] : 0;
+	}
+	return out_p;
+}
+
+int
+gpio_out_set (GPIOout_t *out_p, const int *vals_p)
+{
+	unsigned i;
+	uint64_t end;
+
+	for (i=0; i<out_p->cnt; ++i)
+		out_p->chip->values[out_p->offsets[i]] = vals_p[i];
+	atomic_fetch_add_explicit(&mockWriteCnt_G, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&mockLineWriteCnt_G, out_p->cnt, memory_order_relaxed);
+
+	if (mockWriteNs_G != 0)
+		for (end = mock_now_ns() + mockWriteNs_G; mock_now_ns() < end; )
+			;
+	return 0;
+}
+
+void
+gpio_out_release (GPIOout_t *out_p)
+{
+	free(out_p);
+}
+
+GPIOin_t *
+gpio_in_request (GPIOchip_t *chip_p, unsigned offset, __attribute__((unused)) int debounceMs, bool *debounced_p,
+		__attribute__((unused)) const char *consumer_p)
+{
+	int fds[2];
+	GPIOin_t *in_p;
+
+	*debounced_p = false;
+	in_p = (GPIOin_t*)calloc(1, sizeof(GPIOin_t));
+	if (in_p == NULL)
+		return NULL;
+
+	// never written, the bench has no INPUTs to speak of
+	if (pipe(fds) != 0) {
+		free(in_p);
+		return NULL;
+	}
+	close(fds[1]);
+	in_p->chip = chip_p;
+	in_p->offset = offset;
+	in_p->eventFd = fds[0];
+	return in_p;
+}
+
+int
+gpio_in_fd (GPIOin_t *in_p)
+{
+	return in_p->eventFd;
+}
+
+int
+gpio_in_read (__attribute__((unused)) GPIOin_t *in_p, __attribute__((unused)) GPIOedge_t *edges_p,
+		__attribute__((unused)) unsigned max)
+{
+	return 0;
+}
+
+int
+gpio_in_value (GPIOin_t *in_p)
+{
+	return in_p->chip->values[in_p->offset];
+}
+
+void
+gpio_in_release (GPIOin_t *in_p)
+{
+	close(in_p->eventFd);
+	free(in_p);
+}
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+#ifndef MOCK_GPIOD_H
+#define MOCK_GPIOD_H
+
+#include <stdatomic.h>
+
+// busy time added to every gpio_out_set(), and what was written (from
+// any shard thread)
+extern unsigned long mockWriteNs_G;
+extern atomic_ulong mockWriteCnt_G;
+extern atomic_ulong mockLineWriteCnt_G;
+
+#endif
@@ -0,0 +1,445 @@
+// SPDX-License-Identifier: OSL-3.0
+/*
+ * Copyright (C) 2023  Trevor Woerner <twoerner@gmail.com>
+ */
+
+// load test for the dispatch path: a generated config (or the user's) is
+// loaded as the daemon would, the GPIOs are mock-gpiod lines, and one
+// feeder thread per broker plays the part of that broker's thread,
+// handing mqttgpio_inject() a synthetic or recorded stream; the main
+// thread runs the real main loop and does the actuation (or, with -S, the
+// shard threads do)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <getopt.h>
+
+#include "libmqttgpio-int.h"
+#include "mock-gpiod.h"
+
+#define BENCH_TOPIC_MAX 128
+
+typedef struct {
+	char *topic;
+	char *payload;
+	int payloadLen;
+} BENCHmsg_t;
+
+typedef struct {
+	int brokerIdx;
+	pthread_t thread;
+} FEEDER_t;
+
+static long msgCnt_G = 100000;
+static int gpioCnt_G = 64;
+static int subCnt_G = 64;
+static int chipCnt_G = 1;
+static int cmdCnt_G = 0;
+static int wildPct_G = 0;
+static int payloadLen_G = 0;
+static int brokerCnt_G = 1;
+static int batch_G = 16;
+static int repeat_G = 1;
+static int shardCnt_G = 0;
+static char *replay_G = NULL;
+static char *benchConfig_G = NULL;
+
+// per broker, what its feeder sends (round robin)
+static BENCHmsg_t **stream_G = NULL;
+static int *streamCnt_G = NULL;
+static atomic_int feedersDone_G;
+static MQTTGPIO_t *ctx_G = NULL;
+
+static void bench_usage (char *pgm);
+static void bench_cmdline (int argc, char *argv[]);
+static char *bench_write_config (void);
+static void bench_add_msg (int brokerIdx, const char *topic_p, const char *payload_p, int len);
+static void bench_synth_stream (void);
+static void bench_replay_stream (void);
+static void *bench_feeder (void *data_p);
+static void bench_report (double secs);
+
+int
+main (int argc, char *argv[])
+{
+	int i, ret;
+	char *cfgFile_p;
+	uint64_t startNs, endNs;
+	FEEDER_t *feeders;
+
+	bench_cmdline(argc, argv);
+	cfgFile_p = (benchConfig_G != NULL)? benchConfig_G : bench_write_config();
+
+	ctx_G = mqttgpio_new(cfgFile_p);
+	if (ctx_G == NULL)
+		exit(EXIT_FAILURE);
+	if (ctx_G->cfg->brokerInfoCnt == 0) {
+		printf("no MQTT broker configured\n");
+		exit(EXIT_FAILURE);
+	}
+	mqttgpio_start_offline(ctx_G);
+
+	stream_G = (BENCHmsg_t**)calloc(ctx_G->cfg->brokerInfoCnt, sizeof(BENCHmsg_t*));
+	streamCnt_G = (int*)calloc(ctx_G->cfg->brokerInfoCnt, sizeof(int));
+	feeders = (FEEDER_t*)calloc(ctx_G->cfg->brokerInfoCnt, sizeof(FEEDER_t));
+	if ((stream_G == NULL) || (streamCnt_G == NULL) || (feeders == NULL)) {
+		perror("calloc(stream)");
+		exit(EXIT_FAILURE);
+	}
+	if (replay_G != NULL)
+		bench_replay_stream();
+	else
+		bench_synth_stream();
+
+	printf("%ld message(s), %d broker(s), %d SUB(s), %d GPIO(s) on %d chip(s), %d CMD(s), "
+			"%d%% wildcard, %d byte payloads, %d per pass, %luns per write, %d shard thread(s)\n",
+			msgCnt_G, ctx_G->cfg->brokerInfoCnt, ctx_G->cfg->subInfoCnt, ctx_G->cfg->gpioInfoCnt, ctx_G->chipInfoCnt,
+			ctx_G->cfg->cmdInfoCnt, wildPct_G, payloadLen_G, batch_G, mockWriteNs_G, ctx_G->cfg->shardCnt);
+
+	startNs = now_ns();
+	for (i=0; i<ctx_G->cfg->brokerInfoCnt; ++i) {
+		feeders[i].brokerIdx = i;
+		ret = pthread_create(&feeders[i].thread, NULL, bench_feeder, &feeders[i]);
+		if (ret != 0) {
+			printf("can't start feeder: %s\n", strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+	}
+	mqttgpio_run(ctx_G);
+	endNs = now_ns();
+	for (i=0; i<ctx_G->cfg->brokerInfoCnt; ++i)
+		pthread_join(feeders[i].thread, NULL);
+
+	bench_report((double)(endNs - startNs) / 1e9);
+	mqttgpio_free(ctx_G);
+	if (benchConfig_G == NULL)
+		unlink(cfgFile_p);
+	free(feeders);
+	return EXIT_SUCCESS;
+}
+
+static void
+bench_usage (char *pgm)
+{
+	printf("usage: %s [OPTIONS]\n", pgm);
+	printf("  where <OPTIONS> are:\n");
+	printf("    -h | --help          Print help options to terminal and exit successfully\n");
+	printf("    -n | --messages <n>  Messages to send (default %ld)\n", msgCnt_G);
+	printf("    -g | --gpios <n>     GPIOs in the generated config (default %d)\n", gpioCnt_G);
+	printf("    -s | --subs <n>      SUBs in the generated config (default %d)\n", subCnt_G);
+	printf("    -k | --chips <n>     Spread the GPIOs over <n> chips (default %d)\n", chipCnt_G);
+	printf("    -C | --cmds <n>      The first <n> SUBs run /bin/true instead (default %d)\n", cmdCnt_G);
+	printf("    -w | --wildcard <%%>  Share of SUBs with a '+' or '#' filter (default %d)\n", wildPct_G);
+	printf("    -p | --payload <n>   Pad payloads to <n> bytes as JSON (default: plain ON/OFF)\n");
+	printf("    -b | --brokers <n>   Brokers, each with its own feeder thread (default %d)\n", brokerCnt_G);
+	printf("    -B | --batch <n>     Messages per broker pass before the main thread is woken (default %d)\n", batch_G);
+	printf("    -W | --write-ns <n>  Time each mock gpio write takes (default 0)\n");
+	printf("    -R | --repeat <n>    Send each ON and each OFF <n> times in a row, like a republished state (default %d)\n", repeat_G);
+	printf("    -S | --shards <n>    Write the pins from <n> shard threads, the chips dealt out among them (default: main loop)\n");
+	printf("    -r | --replay <f>    Send the '<topic> <payload>' lines of <f> instead, in a loop\n");
+	printf("    -c | --config <f>    Use <f> instead of a generated config\n");
+}
+
+static void
+bench_cmdline (int argc, char *argv[])
+{
+	int c;
+	struct option longOpts[] = {
+		{"help",     no_argument,       NULL, 'h'},
+		{"messages", required_argument, NULL, 'n'},
+		{"gpios",    required_argument, NULL, 'g'},
+		{"subs",     required_argument, NULL, 's'},
+		{"chips",    required_argument, NULL, 'k'},
+		{"cmds",     required_argument, NULL, 'C'},
+		{"wildcard", required_argument, NULL, 'w'},
+		{"payload",  required_argument, NULL, 'p'},
+		{"brokers",  required_argument, NULL, 'b'},
+		{"batch",    required_argument, NULL, 'B'},
+		{"write-ns", required_argument, NULL, 'W'},
+		{"repeat",   required_argument, NULL, 'R'},
+		{"shards",   required_argument, NULL, 'S'},
+		{"replay",   required_argument, NULL, 'r'},
+		{"config",   required_argument, NULL, 'c'},
+		{NULL, 0, NULL, 0},
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "hn:g:s:k:C:w:p:b:B:W:R:S:r:c:", longOpts, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+			case 'h':
+				bench_usage(argv[0]);
+				exit(EXIT_SUCCESS);
+			case 'n':
+				msgCnt_G = atol(optarg);
+				break;
+			case 'g':
+				gpioCnt_G = atoi(optarg);
+				break;
+			case 's':
+				subCnt_G = atoi(optarg);
+				break;
+			case 'k':
+				chipCnt_G = atoi(optarg);
+				break;
+			case 'C':
+				cmdCnt_G = atoi(optarg);
+				break;
+			case 'w':
+				wildPct_G = atoi(optarg);
+				break;
+			case 'p':
+				payloadLen_G = atoi(optarg);
+				break;
+			case 'b':
+				brokerCnt_G = atoi(optarg);
+				break;
+			case 'B':
+				batch_G = atoi(optarg);
+				break;
+			case 'W':
+				mockWriteNs_G = strtoul(optarg, NULL, 0);
+				break;
+			case 'R':
+				repeat_G = atoi(optarg);
+				break;
+			case 'S':
+				shardCnt_G = atoi(optarg);
+				break;
+			case 'r':
+				replay_G = optarg;
+				break;
+			case 'c':
+				benchConfig_G = optarg;
+				break;
+			default:
+				bench_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if ((msgCnt_G <= 0) || (gpioCnt_G <= 0) || (subCnt_G <= 0) || (chipCnt_G <= 0) || (cmdCnt_G < 0)
+			|| (wildPct_G < 0) || (wildPct_G > 100) || (payloadLen_G < 0) || (brokerCnt_G <= 0)
+			|| (batch_G <= 0) || (repeat_G <= 0) || (shardCnt_G < 0) || (shardCnt_G > SHARD_MAX)) {
+		printf("counts must be positive, the wildcard share 0..100, shards 0..%d\n", SHARD_MAX);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// topics are bench/<group>/<n>/set, 16 to a group; a wildcard SUB takes
+// its topic's whole group, any group, or everything below its group
+static char *
+bench_write_config (void)
+{
+	int i, fd, group;
+	char *name_p;
+	FILE *stream;
+
+	name_p = strdup("/tmp/mqtt-gpio-bench.XXXXXX");
+	if (name_p == NULL) {
+		perror("strdup(config name)");
+		exit(EXIT_FAILURE);
+	}
+	fd = mkstemp(name_p);
+	if (fd < 0) {
+		perror("mkstemp()");
+		exit(EXIT_FAILURE);
+	}
+	stream = fdopen(fd, "w");
+	if (stream == NULL) {
+		perror("fdopen()");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(stream, "MQTT localhost 1883\n");
+	if (shardCnt_G > 0)
+		fprintf(stream, "SHARDS %d\n", shardCnt_G);
+	for (i=1; i<brokerCnt_G; ++i)
+		fprintf(stream, "BROKER b%d localhost 1883\n", i);
+	for (i=0; i<gpioCnt_G; ++i)
+		fprintf(stream, "GPIO g%d benchchip%d %d\n", i, i % chipCnt_G, i / chipCnt_G);
+	for (i=0; i<cmdCnt_G; ++i)
+		fprintf(stream, "CMD c%d /bin/true\n", i);
+
+	for (i=0; i<subCnt_G; ++i) {
+		group = i / 16;
+		if ((i * 100 / subCnt_G) < wildPct_G) {
+			switch (i % 3) {
+				case 0:
+					fprintf(stream, "SUB bench/%d/+/set", group);
+					break;
+				case 1:
+					fprintf(stream, "SUB bench/+/%d/set", i);
+					break;
+				default:
+					fprintf(stream, "SUB bench/%d/#", group);
+					break;
+			}
+		}
+		else
+			fprintf(stream, "SUB bench/%d/%d/set", group, i);
+
+		if (i < cmdCnt_G)
+			fprintf(stream, " c%d 0", i);
+		else
+			fprintf(stream, " g%d 0", i % gpioCnt_G);
+		if ((i % brokerCnt_G) != 0)
+			fprintf(stream, " BROKER=b%d", i % brokerCnt_G);
+		fprintf(stream, "\n");
+	}
+	fclose(stream);
+	return name_p;
+}
+
+static void
+bench_add_msg (int brokerIdx, const char *topic_p, const char *payload_p, int len)
+{
+	BENCHmsg_t *msg_p;
+
+	stream_G[brokerIdx] = (BENCHmsg_t*)realloc(stream_G[brokerIdx], (streamCnt_G[brokerIdx] + 1) * sizeof(BENCHmsg_t));
+	if (stream_G[brokerIdx] == NULL) {
+		perror("realloc(stream)");
+		exit(EXIT_FAILURE);
+	}
+	msg_p = &stream_G[brokerIdx][streamCnt_G[brokerIdx]++];
+	msg_p->topic = strdup(topic_p);
+	msg_p->payload = (char*)malloc(len + 1);
+	if ((msg_p->topic == NULL) || (msg_p->payload == NULL)) {
+		perror("malloc(message)");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(msg_p->payload, payload_p, len);
+	msg_p->payload[len] = 0;
+	msg_p->payloadLen = len;
+}
+
+// every SUB's topic with ON, then again with OFF, on the SUB's broker;
+// each one repeat_G times over
+static void
+bench_synth_stream (void)
+{
+	int i, r, on, len;
+	char topic[BENCH_TOPIC_MAX];
+	char *payload_p;
+
+	payload_p = (char*)malloc(payloadLen_G + 32);
+	if (payload_p == NULL) {
+		perror("malloc(payload)");
+		exit(EXIT_FAILURE);
+	}
+	for (on=1; on>=0; --on) {
+		for (i=0; i<subCnt_G; ++i) {
+			snprintf(topic, sizeof(topic), "bench/%d/%d/set", i / 16, i);
+			len = snprintf(payload_p, payloadLen_G + 32, "{\"state\":\"%s\",\"pad\":\"", on? "ON" : "OFF");
+			if (len + 2 > payloadLen_G)
+				len = snprintf(payload_p, payloadLen_G + 32, "%s", on? "ON" : "OFF");
+			else {
+				while (len < payloadLen_G - 2)
+					payload_p[len++] = 'x';
+				payload_p[len++] = '"';
+				payload_p[len++] = '}';
+			}
+			for (r=0; r<repeat_G; ++r)
+				bench_add_msg(i % ctx_G->cfg->brokerInfoCnt, topic, payload_p, len);
+		}
+	}
+	free(payload_p);
+}
+
+// '<topic> <payload>' per line, all on the first broker
+static void
+bench_replay_stream (void)
+{
+	char *line = NULL, *sep_p;
+	size_t len = 0;
+	ssize_t nread;
+	FILE *stream;
+
+	stream = fopen(replay_G, "r");
+	if (stream == NULL) {
+		perror("fopen()");
+		printf("%s\n", replay_G);
+		exit(EXIT_FAILURE);
+	}
+	while ((nread = getline(&line, &len, stream)) != -1) {
+		while ((nread > 0) && ((line[nread-1] == '\n') || (line[nread-1] == '\r')))
+			line[--nread] = 0;
+		if ((nread == 0) || (line[0] == '#'))
+			continue;
+		sep_p = strchr(line, ' ');
+		if (sep_p == NULL)
+			continue;
+		*sep_p++ = 0;
+		bench_add_msg(0, line, sep_p, strlen(sep_p));
+	}
+	free(line);
+	fclose(stream);
+
+	if (streamCnt_G[0] == 0) {
+		printf("nothing to replay in %s\n", replay_G);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// stands in for a broker thread: a pass of 'batch' messages, then the
+// wakeup a broker thread's pass ends with; a ring over half full is let
+// drain so nothing is dropped; the last feeder to finish stops the main
+// loop
+static void *
+bench_feeder (void *data_p)
+{
+	long i, cnt;
+	FEEDER_t *feeder_p = (FEEDER_t*)data_p;
+	int brokerIdx = feeder_p->brokerIdx;
+	BENCHmsg_t *msg_p;
+
+	cnt = (replay_G != NULL)? msgCnt_G : msgCnt_G / ctx_G->cfg->brokerInfoCnt
+			+ (brokerIdx < msgCnt_G % ctx_G->cfg->brokerInfoCnt);
+	if (streamCnt_G[brokerIdx] == 0)
+		cnt = 0;
+
+	for (i=0; i<cnt; ++i) {
+		while (mqttgpio_inject_pending(ctx_G, brokerIdx) > ACTION_RING_SIZE / 2) {
+			mqttgpio_inject_flush(ctx_G, brokerIdx);
+			sched_yield();
+		}
+
+		msg_p = &stream_G[brokerIdx][i % streamCnt_G[brokerIdx]];
+		mqttgpio_inject(ctx_G, brokerIdx, msg_p->topic, msg_p->payload, msg_p->payloadLen);
+		if (((i + 1) % batch_G) == 0)
+			mqttgpio_inject_flush(ctx_G, brokerIdx);
+	}
+	mqttgpio_inject_flush(ctx_G, brokerIdx);
+
+	while (mqttgpio_inject_pending(ctx_G, brokerIdx) != 0)
+		sched_yield();
+	if (atomic_fetch_add(&feedersDone_G, 1) + 1 == ctx_G->cfg->brokerInfoCnt) {
+		mqttgpio_stop(ctx_G);
+	}
+	return NULL;
+}
+
+static void
+bench_report (double secs)
+{
+	int i;
+	unsigned long cnt, p50, p99, max, dropped = 0, pinSkip, writeSkip;
+
+	for (i=0; i<ctx_G->cfg->brokerInfoCnt; ++i)
+		dropped += ctx_G->cfg->brokerInfo[i].ring.dropped;
+
+	printf("%.3fs, %.0f messages/s, %lu gpio write(s) of %.1f line(s) on average, %lu dropped\n",
+			secs, (double)msgCnt_G / secs, (unsigned long)mockWriteCnt_G,
+			mockWriteCnt_G? (double)mockLineWriteCnt_G / (double)mockWriteCnt_G : 0.0, dropped);
+	shard_counts(ctx_G, &pinSkip, &writeSkip);
+	printf("skipped: %lu pin set(s) already in place, %lu write(s) with nothing to change\n", pinSkip, writeSkip);
+	printf("latency (us)          count        p50        p99        max\n");
+	for (i=0; i<STAT_CNT; ++i) {
+		hist_summary(&ctx_G->stageHist[i], &cnt, &p50, &p99, &max);
+		printf("  %-16s %10lu %10lu %10lu %10lu\n", stageName_G[i], cnt, p50, p99, max);
+	}
+}